@@ -0,0 +1,118 @@
+// arena.cpp : per-type entity pools.
+//
+
+#include "stdafx.h"
+#include "arena.h"
+
+#include <assert.h>
+
+std::atomic<size_t> entity_arena::s_next_pool_index(0);
+const size_t entity_arena::slots_per_chunk;
+
+entity_arena::~entity_arena()
+{
+	reset();
+}
+
+void entity_arena::mark(const chunk_ref& chunk, const char* start, const char* slot, unsigned char live)
+{
+	if (!chunk.owner->skip_destructor)
+	{
+		chunk.owner->live[chunk.index][(slot - start) / chunk.owner->slot_size] = live;
+	}
+}
+
+void* entity_arena::allocate(pool& p)
+{
+	char* slot;
+	if (p.free_list)
+	{
+		slot = static_cast<char*>(p.free_list);
+		p.free_list = *reinterpret_cast<void**>(slot);
+	}
+	else
+	{
+		if (p.next_unused == slots_per_chunk)
+		{
+			// move on to the next chunk, reusing one kept from before a reset
+			p.current = p.chunks.empty() ? 0 : p.current + 1;
+			if (p.current == p.chunks.size())
+			{
+				p.chunks.emplace_back(new char[p.slot_size * slots_per_chunk]);
+				if (!p.skip_destructor)
+				{
+					p.live.emplace_back(slots_per_chunk, 0);
+				}
+				chunk_ref ref = { &p, p.current };
+				m_chunks[p.chunks.back().get()] = ref;
+			}
+			p.next_unused = 0;
+		}
+		slot = p.chunks[p.current].get() + p.next_unused * p.slot_size;
+		p.next_unused++;
+	}
+	if (!p.skip_destructor)
+	{
+		auto found = --m_chunks.upper_bound(slot);
+		mark(found->second, found->first, slot, 1);
+	}
+	return slot;
+}
+
+void entity_arena::destroy(entity* e)
+{
+	// the slot starts at the most derived object, not necessarily at e
+	char* slot = static_cast<char*>(dynamic_cast<void*>(e));
+	auto found = m_chunks.upper_bound(slot);
+	assert(found != m_chunks.begin());
+	--found;
+	pool& p = *found->second.owner;
+	p.destructor(slot);
+	mark(found->second, found->first, slot, 0);
+	*reinterpret_cast<void**>(slot) = p.free_list;
+	p.free_list = slot;
+}
+
+void entity_arena::reset()
+{
+	for (auto& owned : m_pools)
+	{
+		if (!owned)
+		{
+			continue;
+		}
+		pool& p = *owned;
+		if (!p.skip_destructor)
+		{
+			for (size_t c = 0; c < p.chunks.size(); ++c)
+			{
+				for (size_t i = 0; i < slots_per_chunk; ++i)
+				{
+					if (p.live[c][i])
+					{
+						p.destructor(p.chunks[c].get() + i * p.slot_size);
+						p.live[c][i] = 0;
+					}
+				}
+			}
+		}
+		// rewind: every chunk is unused again, so the free list starts empty
+		p.current = 0;
+		p.next_unused = p.chunks.empty() ? slots_per_chunk : 0;
+		p.free_list = nullptr;
+	}
+}
+
+size_t entity_arena::bytes() const
+{
+	size_t total = 0;
+	for (auto& owned : m_pools)
+	{
+		if (owned)
+		{
+			total += owned->chunks.size() * slots_per_chunk * owned->slot_size;
+			total += owned->live.size() * slots_per_chunk;
+		}
+	}
+	return total;
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include "entity.h"
+
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Whether the arena may drop objects of type T on reset() without running
+// their destructor. Entities always have a virtual destructor, so an entity
+// type whose destructor does nothing observable opts in with a specialisation.
+template <class T>
+struct arena_skip_destructor : std::is_trivially_destructible<T> {};
+
+// Per-type fixed-size pools for entities. Every dynamic type gets its own
+// pool, so objects of one type sit next to each other in memory, and tearing
+// down a whole world is a reset of each pool rather than one delete per object.
+class entity_arena
+{
+public:
+	entity_arena() {}
+	~entity_arena();
+	entity_arena(const entity_arena&) = delete;
+	entity_arena& operator=(const entity_arena&) = delete;
+
+	template <class T, class... Args>
+	T* create(Args&&... args)
+	{
+		pool& p = pool_for<T>();
+		void* slot = allocate(p);
+		return new (slot) T(std::forward<Args>(args)...);
+	}
+
+	// Destroy one object made by create() and recycle its slot.
+	void destroy(entity* e);
+
+	// Destroy every object. Pools whose type opted into arena_skip_destructor
+	// just rewind, which is O(1) per pool; the memory is kept for the next world.
+	void reset();
+
+	// Bytes held by the pools: every chunk, plus live flags where kept.
+	size_t bytes() const;
+
+private:
+	struct pool
+	{
+		size_t slot_size;
+		bool skip_destructor;
+		void (*destructor)(void*);
+		std::vector<std::unique_ptr<char[]>> chunks;
+		std::vector<std::vector<unsigned char>> live; // only kept when the destructor runs
+		size_t current;     // chunk new slots come from
+		size_t next_unused; // slots handed out from the current chunk
+		void* free_list;
+	};
+
+	struct chunk_ref
+	{
+		pool* owner;
+		size_t index;
+	};
+
+	static const size_t slots_per_chunk = 256;
+
+	template <class T>
+	static size_t pool_index()
+	{
+		static const size_t index = s_next_pool_index++;
+		return index;
+	}
+
+	template <class T>
+	pool& pool_for()
+	{
+		const size_t index = pool_index<T>();
+		if (index >= m_pools.size())
+		{
+			m_pools.resize(index + 1);
+		}
+		if (!m_pools[index])
+		{
+			pool* p = new pool();
+			const size_t align = alignof(T) > sizeof(void*) ? alignof(T) : sizeof(void*);
+			p->slot_size = (sizeof(T) + align - 1) / align * align;
+			p->skip_destructor = arena_skip_destructor<T>::value;
+			p->destructor = [](void* object) { static_cast<T*>(object)->~T(); };
+			p->current = 0;
+			p->next_unused = slots_per_chunk;
+			p->free_list = nullptr;
+			m_pools[index].reset(p);
+		}
+		return *m_pools[index];
+	}
+
+	void* allocate(pool& p);
+	void mark(const chunk_ref& chunk, const char* start, const char* slot, unsigned char live);
+
+	static std::atomic<size_t> s_next_pool_index;
+
+	std::vector<std::unique_ptr<pool>> m_pools;
+	// chunk start -> owning pool, for destroy()
+	std::map<const char*, chunk_ref> m_chunks;
+};
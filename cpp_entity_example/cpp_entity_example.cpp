@@ -5,6 +5,21 @@
 #include "entity.h"
 #include "lerp.h"
 #include "hermite.h"
+#include "packed.h"
+#include "scheduler.h"
+#include "registry.h"
+#include "arena.h"
+#include "poly_collection.h"
+#include "prefetch.h"
+#include "interleave.h"
+#include "pipeline.h"
+#include "world.h"
+#include "ecs.h"
+#ifdef __GNUC__
+// Itanium ABI member pointers, for the method pointer example
+#include "../pmf_testbed/unified_call_cast.hpp"
+#include "../pmf_testbed/icf.hpp"
+#endif
 
 #include <vector>
 #include <memory>
@@ -14,6 +29,8 @@
 #include <chrono>
 #include <ctime>
 #include <algorithm>
+#include <atomic>
+#include <thread>
 
 using namespace std;
 
@@ -23,8 +40,85 @@ int dummyOutIndex = 0;
 vector<std::chrono::duration<double, std::ratio<1, 1000>>> gSlowSimpleUpdateExampleTimers;
 vector<std::chrono::duration<double, std::ratio<1, 1000>>> gSlowComplicatedUpdateExampleTimers;
 vector<std::chrono::duration<double, std::ratio<1, 1000>>> gFastUpdateExampleTimers;
+vector<std::chrono::duration<double, std::ratio<1, 1000>>> gMultiSampleStepTimers;
+vector<std::chrono::duration<double, std::ratio<1, 1000>>> gMultiSampleBatchTimers;
+
+struct PackedReport
+{
+	param_format format;
+	size_t bytes;
+	param_error lerp_error;
+	param_error hermite_error;
+	// the batch kernels, one sample per entity per frame into frame arrays
+	std::chrono::duration<double, std::ratio<1, 1000>> time;
+	// UpdateAll, bound by its per-entity store to dummyOut in every format
+	std::chrono::duration<double, std::ratio<1, 1000>> update_all_time;
+};
+vector<PackedReport> gPackedUpdateReports;
+vector<std::chrono::duration<double, std::ratio<1, 1000>>> gParallelSerialTimers;
+vector<std::chrono::duration<double, std::ratio<1, 1000>>> gParallelUpdateTimers;
+unsigned gParallelWorkers = 0;
+
+struct SpawnReport
+{
+	int frames;
+	size_t applied;
+	size_t live;
+	std::chrono::duration<double, std::ratio<1, 1000>> apply_time;
+	std::chrono::duration<double, std::ratio<1, 1000>> update_time;
+	std::chrono::duration<double, std::ratio<1, 1000>> worst_frame;
+};
+vector<SpawnReport> gConcurrentSpawnReports;
+vector<std::chrono::duration<double, std::ratio<1, 1000>>> gHeapUpdateTimers;
+vector<std::chrono::duration<double, std::ratio<1, 1000>>> gHeapTeardownTimers;
+vector<std::chrono::duration<double, std::ratio<1, 1000>>> gArenaUpdateTimers;
+vector<std::chrono::duration<double, std::ratio<1, 1000>>> gArenaTeardownTimers;
+vector<std::chrono::duration<double, std::ratio<1, 1000>>> gPolyCollectionUpdateTimers;
+vector<std::chrono::duration<double, std::ratio<1, 1000>>> gPolyCollectionForEachTimers;
+
+struct PrefetchReport
+{
+	size_t entities;
+	size_t object_distance;
+	size_t vtable_distance;
+	double ns_per_update;
+};
+vector<PrefetchReport> gPrefetchSweepReports;
+
+struct InterleaveReport
+{
+	size_t entities;
+	size_t group; // 0 for the plain loop
+	double ns_per_update;
+	double gain; // plain loop time over this time
+};
+vector<InterleaveReport> gInterleavedUpdateReports;
+
+struct PipelineReport
+{
+	size_t buffers; // 1 is the unpipelined baseline
+	int frames;
+	double frames_per_second;
+	std::chrono::duration<double, std::ratio<1, 1000>> mean_latency;
+	std::chrono::duration<double, std::ratio<1, 1000>> worst_latency;
+};
+vector<PipelineReport> gPipelinedFrameReports;
+
+struct BackendReport
+{
+	const char* backend;
+	size_t entities;
+	size_t bytes;
+	std::chrono::duration<double, std::ratio<1, 1000>> spawn_time;
+	std::chrono::duration<double, std::ratio<1, 1000>> update_time;
+	std::chrono::duration<double, std::ratio<1, 1000>> despawn_time; // half the world, in random order
+};
+vector<BackendReport> gEcsComparisonReports;
 #ifdef __GNUC__
 vector<std::chrono::duration<double, std::ratio<1, 1000>>> gMethodPointerUpdateExampleTimers;
+vector<std::chrono::duration<double, std::ratio<1, 1000>>> gMethodPointerGetFunctionPointerTimers;
+vector<std::chrono::duration<double, std::ratio<1, 1000>>> gMethodPointerSlotProbeTimers;
+vector<std::chrono::duration<double, std::ratio<1, 1000>>> gMethodPointerGatherTimers;
 #endif
 
 
@@ -250,22 +344,59 @@ void MethodPointerUpdateExampleTimers()
 		}
 	}
 
+	// make a typedef to avoid mistakes
+	typedef  void (entity::*memfun)(float y) const;
+	// any object of the type I have a fast loop for gives its update function
+	const entity* lerp_fast = nullptr;
+	for (auto &a : entity_vec)
+	{
+		if (a->GetType() == entity_lerp_fast::type)
+		{
+			lerp_fast = a.get();
+			break;
+		}
+	}
+
+	// Identical code folding can give the fast type's Update the address of
+	// another function, whose entities would then match the key and never be
+	// updated. The fast hermite store's Update has the same body, so it is
+	// registered first: a fold is caught against it even without symbols.
+	// A refused key leaves no fast path, and every entity takes the virtual call.
+	if (lerp_fast)
+	{
+		stop::icf::fast_path_keys keys(stop::icf::policy::refuse);
+		unique_ptr<entity> hermite_fast(create_entity_hermite_fast(0.0f, 0.0f, 0.0f, 0.0f));
+		keys.add(stop::GetFunctionPointer(hermite_fast.get(), &entity::Update), "entity_hermite_fast Update");
+		if (!keys.add(stop::GetFunctionPointer(lerp_fast, &entity::Update), "entity_lerp_fast_impl::Update"))
+		{
+			lerp_fast = nullptr;
+		}
+	}
+
 	{
 		// change styles for document 
 		mytimer timer;
-		// make a typedef to avoid mistakes
-		typedef  void (entity::*memfun)(float y) const;
 		// create a member function that points to update function that I have a fast loop for 
 		// The GCC extention looks like you can do this. 
 		memfun mf = &entity::Update;
 
-		as_normfun snf = (as_normfun)(&entity_lerp_fast_impl::Update);
+#ifdef __clang__
+		// Clang has no bound member function extension: unified_call_cast reads
+		// the same vtable slot.
+		as_normfun snf = lerp_fast ? stop::unified_call_cast<as_normfun>(*lerp_fast, mf) : nullptr;
+#else
+		as_normfun snf = lerp_fast ? (as_normfun)(&entity_lerp_fast_impl::Update) : nullptr;
+#endif
 		for (float t = 0.0f; t < 1.0; t += 0.05f) {
 			for (auto &a : entity_vec) {
 				
 				const entity& e = *(&(*a)); 
 
+#ifdef __clang__
+				as_normfun dnf = stop::unified_call_cast<as_normfun>(e, mf);
+#else
 				as_normfun dnf = (as_normfun)(e.*mf);
+#endif
 				// if we have a fast loop for this object don't update
 				// so in this case we on the hermite entity but not the lerp ones. 
 				if (snf != dnf) {
@@ -277,8 +408,911 @@ void MethodPointerUpdateExampleTimers()
 		}
 		gMethodPointerUpdateExampleTimers.emplace_back(timer.stop());
 	}
+
+	{
+		// the same loop against stop::GetFunctionPointer, which takes the const
+		// member function as it is and gives a function taking a const entity*
+		mytimer timer;
+		memfun mf = &entity::Update;
+
+		typedef void(*as_constfun)(const entity *_this, float y);
+		as_constfun snf = lerp_fast ? stop::GetFunctionPointer(lerp_fast, mf) : nullptr;
+		for (float t = 0.0f; t < 1.0; t += 0.05f) {
+			for (auto &a : entity_vec) {
+				const entity& e = *a;
+				as_constfun dnf = stop::GetFunctionPointer(&e, mf);
+				if (snf != dnf) {
+					a->Update(t);
+				}
+			}
+			entity_lerp_fast::UpdateAll(t);
+		}
+		gMethodPointerGetFunctionPointerTimers.emplace_back(timer.stop());
+	}
+
+	{
+		// the virtual or not test and the slot are worked out once, leaving a
+		// vptr load, slot load and compare per entity
+		mytimer timer;
+		stop::slot_probe<memfun> probe = lerp_fast ? stop::slot_probe<memfun>(&entity::Update, lerp_fast) : stop::slot_probe<memfun>(&entity::Update);
+		for (float t = 0.0f; t < 1.0; t += 0.05f) {
+			for (auto &a : entity_vec) {
+				if (!probe.matches(a.get())) {
+					a->Update(t);
+				}
+			}
+			entity_lerp_fast::UpdateAll(t);
+		}
+		gMethodPointerSlotProbeTimers.emplace_back(timer.stop());
+	}
+
+	{
+		// probe the whole array with gathers (AVX2 or AVX-512 when built with
+		// them) and compact the entities that need a virtual call into a list,
+		// so the update loop has no skip test at all
+		vector<const entity*> entity_ptrs;
+		for (auto &a : entity_vec)
+		{
+			entity_ptrs.push_back(a.get());
+		}
+		vector<uint32_t> slow(entity_ptrs.size());
+		mytimer timer;
+		stop::slot_probe<memfun> probe = lerp_fast ? stop::slot_probe<memfun>(&entity::Update, lerp_fast) : stop::slot_probe<memfun>(&entity::Update);
+		for (float t = 0.0f; t < 1.0; t += 0.05f) {
+			size_t count = stop::PartitionSlowPath(probe, entity_ptrs.data(), entity_ptrs.size(), slow.data());
+			for (size_t i = 0; i < count; ++i) {
+				entity_ptrs[slow[i]]->Update(t);
+			}
+			entity_lerp_fast::UpdateAll(t);
+		}
+		gMethodPointerGatherTimers.emplace_back(timer.stop());
+	}
+}
+#endif
+
+void MultiSampleUpdateExampleTimers()
+{
+#ifdef PRINT
+	cout << "MultiSampleUpdateExampleTimers" << endl;
+#endif
+	default_random_engine generator;
+	uniform_real_distribution<float> distribution(0, 1);
+
+	int number_of_lerp = 400;
+	int number_of_hermite = 1000;
+	vector<unique_ptr<entity>> entity_vec;
+	for (int i = 0; i < number_of_lerp; i++)
+	{
+		unique_ptr<entity> a(create_entity_lerp_fast(distribution(generator), distribution(generator)));
+		entity_vec.emplace_back(std::move(a));
+	}
+	for (int i = 0; i < number_of_hermite; i++)
+	{
+		unique_ptr<entity> a(create_entity_hermite_fast(distribution(generator), distribution(generator), distribution(generator), distribution(generator)));
+		entity_vec.emplace_back(std::move(a));
+	}
+
+	// the same time samples the other examples step through one at a time
+	vector<float> samples;
+	for (float t = 0.0f; t < 1.0; t += 0.05f) {
+		samples.push_back(t);
+	}
+
+	{
+		// one pass over each store per time sample
+		mytimer timer;
+		for (float t = 0.0f; t < 1.0; t += 0.05f) {
+			entity_lerp_fast::UpdateAll(t);
+			entity_hermite_fast::UpdateAll(t);
+		}
+		gMultiSampleStepTimers.emplace_back(timer.stop());
+	}
+
+	{
+		// one pass over each store for all time samples
+		vector<float> lerp_out(entity_lerp_fast::Count() * samples.size());
+		vector<float> hermite_out(entity_hermite_fast::Count() * samples.size());
+		mytimer timer;
+		entity_lerp_fast::UpdateAllSamples(samples.data(), samples.size(), lerp_out.data());
+		entity_hermite_fast::UpdateAllSamples(samples.data(), samples.size(), hermite_out.data());
+		gMultiSampleBatchTimers.emplace_back(timer.stop());
+
+		dummyOut[dummyOutIndex % ARRAY_SIZE(dummyOut)] = lerp_out.back() + hermite_out.back();
+		dummyOutIndex++;
+	}
+}
+
+void PackedUpdateExampleTimers()
+{
+#ifdef PRINT
+	cout << "PackedUpdateExampleTimers" << endl;
+#endif
+	default_random_engine generator;
+	uniform_real_distribution<float> distribution(0, 1);
+
+	// big enough that the stores come from memory rather than cache
+	int number_of_lerp = 400 * 256;
+	int number_of_hermite = 1000 * 256;
+	vector<unique_ptr<entity>> entity_vec;
+	for (int i = 0; i < number_of_lerp; i++)
+	{
+		unique_ptr<entity> a(create_entity_lerp_fast(distribution(generator), distribution(generator)));
+		entity_vec.emplace_back(std::move(a));
+	}
+	for (int i = 0; i < number_of_hermite; i++)
+	{
+		unique_ptr<entity> a(create_entity_hermite_fast(distribution(generator), distribution(generator), distribution(generator), distribution(generator)));
+		entity_vec.emplace_back(std::move(a));
+	}
+
+	vector<float> samples;
+	for (float t = 0.0f; t < 1.0; t += 0.05f) {
+		samples.push_back(t);
+	}
+
+	// the float path is the reference the packed formats are measured against
+	entity_lerp_fast::SetParamFormat(param_format::fp32);
+	entity_hermite_fast::SetParamFormat(param_format::fp32);
+	vector<float> lerp_ref(entity_lerp_fast::Count() * samples.size());
+	vector<float> hermite_ref(entity_hermite_fast::Count() * samples.size());
+	entity_lerp_fast::UpdateAllSamples(samples.data(), samples.size(), lerp_ref.data());
+	entity_hermite_fast::UpdateAllSamples(samples.data(), samples.size(), hermite_ref.data());
+
+	vector<float> lerp_out(lerp_ref.size());
+	vector<float> hermite_out(hermite_ref.size());
+	const param_format formats[] = { param_format::fp32, param_format::fp16, param_format::fixed16 };
+	for (auto format : formats)
+	{
+		entity_lerp_fast::SetParamFormat(format);
+		entity_hermite_fast::SetParamFormat(format);
+
+		PackedReport report;
+		report.format = format;
+		report.bytes = entity_lerp_fast::ParamBytes() + entity_hermite_fast::ParamBytes();
+
+		entity_lerp_fast::UpdateAllSamples(samples.data(), samples.size(), lerp_out.data());
+		entity_hermite_fast::UpdateAllSamples(samples.data(), samples.size(), hermite_out.data());
+		report.lerp_error = compare_outputs(lerp_ref.data(), lerp_out.data(), lerp_ref.size());
+		report.hermite_error = compare_outputs(hermite_ref.data(), hermite_out.data(), hermite_ref.size());
+
+		{
+			// the decode is SIMD (F16C, AVX2 or vectorised scalar) across a block of
+			// entities, so this is where halving the bytes can show
+			vector<float> lerp_frame(entity_lerp_fast::Count());
+			vector<float> hermite_frame(entity_hermite_fast::Count());
+			mytimer timer;
+			for (float t = 0.0f; t < 1.0; t += 0.05f) {
+				entity_lerp_fast::UpdateAllSamples(&t, 1, lerp_frame.data());
+				entity_hermite_fast::UpdateAllSamples(&t, 1, hermite_frame.data());
+			}
+			report.time = timer.stop();
+			dummyOut[dummyOutIndex % ARRAY_SIZE(dummyOut)] = lerp_frame.back() + hermite_frame.back();
+			dummyOutIndex++;
+		}
+		{
+			mytimer timer;
+			for (float t = 0.0f; t < 1.0; t += 0.05f) {
+				entity_lerp_fast::UpdateAll(t);
+				entity_hermite_fast::UpdateAll(t);
+			}
+			report.update_all_time = timer.stop();
+		}
+		gPackedUpdateReports.push_back(report);
+	}
+	entity_lerp_fast::SetParamFormat(param_format::fp32);
+	entity_hermite_fast::SetParamFormat(param_format::fp32);
+}
+
+void ParallelUpdateExampleTimers()
+{
+#ifdef PRINT
+	cout << "ParallelUpdateExampleTimers" << endl;
+#endif
+	default_random_engine generator;
+	uniform_real_distribution<float> distribution(0, 1);
+
+	// one bucket per dynamic type: the two batch stores and the virtual stragglers
+	int number_of_fast_lerp = 400 * 64;
+	int number_of_fast_hermite = 1000 * 64;
+	int number_of_slow = 1000 * 64;
+	vector<long long> create_types;
+	for (int i = 0; i < number_of_fast_lerp; i++)
+	{
+		create_types.emplace_back(entity_lerp_fast::type);
+	}
+	for (int i = 0; i < number_of_fast_hermite; i++)
+	{
+		create_types.emplace_back(entity_hermite_fast::type);
+	}
+	for (int i = 0; i < number_of_slow; i++)
+	{
+		create_types.emplace_back(i % 2 ? entity_hermite::type : entity_lerp_slow::type);
+	}
+
+	shuffle(create_types.begin(), create_types.end(), generator);
+
+	vector<unique_ptr<entity>> entity_vec;
+	vector<const entity*> stragglers;
+	for (auto &create_type : create_types)
+	{
+		unique_ptr<entity> a;
+		if (create_type == entity_lerp_fast::type)
+		{
+			a.reset(create_entity_lerp_fast(distribution(generator), distribution(generator)));
+		}
+		else if (create_type == entity_hermite_fast::type)
+		{
+			a.reset(create_entity_hermite_fast(distribution(generator), distribution(generator), distribution(generator), distribution(generator)));
+		}
+		else if (create_type == entity_hermite::type)
+		{
+			a.reset(create_entity_hermite(distribution(generator), distribution(generator), distribution(generator), distribution(generator)));
+			stragglers.push_back(a.get());
+		}
+		else
+		{
+			a.reset(create_entity_lerp_slow(distribution(generator), distribution(generator)));
+			stragglers.push_back(a.get());
+		}
+		entity_vec.emplace_back(std::move(a));
+	}
+
+	{
+		mytimer timer;
+		for (float t = 0.0f; t < 1.0; t += 0.05f) {
+			for (auto a : stragglers) {
+				a->Update(t);
+			}
+			entity_lerp_fast::UpdateAll(t);
+			entity_hermite_fast::UpdateAll(t);
+		}
+		gParallelSerialTimers.emplace_back(timer.stop());
+	}
+
+	{
+		work_stealing_pool pool(std::thread::hardware_concurrency());
+		gParallelWorkers = pool.workers();
+		entity_lerp_fast::PackParams();
+		entity_hermite_fast::PackParams();
+
+		// big enough to amortise a steal, small enough that the largest bucket
+		// still splits into several chunks per worker
+		const size_t chunk = 2048;
+		auto chunks = [chunk](size_t n) { return (n + chunk - 1) / chunk; };
+		// one sink per chunk of a frame: a chunk's tasks for successive frames
+		// are ordered by wait(), so no two tasks ever write the same sink at once
+		vector<output_sink> sinks(chunks(stragglers.size()) + chunks(entity_lerp_fast::Count()) + chunks(entity_hermite_fast::Count()), output_sink());
+		mytimer timer;
+		for (float t = 0.0f; t < 1.0; t += 0.05f) {
+			unsigned next = 0;
+			for (size_t begin = 0; begin < stragglers.size(); begin += chunk) {
+				const size_t end = min(begin + chunk, stragglers.size());
+				output_sink* sink = &sinks[next];
+				pool.push(next++, [&stragglers, sink, begin, end, t]() {
+					for (size_t i = begin; i < end; ++i) {
+						stragglers[i]->UpdateInto(t, *sink);
+					}
+				});
+			}
+			for (size_t begin = 0; begin < entity_lerp_fast::Count(); begin += chunk) {
+				const size_t end = min(begin + chunk, entity_lerp_fast::Count());
+				output_sink* sink = &sinks[next];
+				pool.push(next++, [sink, begin, end, t]() {
+					entity_lerp_fast::UpdateRange(t, begin, end, *sink);
+				});
+			}
+			for (size_t begin = 0; begin < entity_hermite_fast::Count(); begin += chunk) {
+				const size_t end = min(begin + chunk, entity_hermite_fast::Count());
+				output_sink* sink = &sinks[next];
+				pool.push(next++, [sink, begin, end, t]() {
+					entity_hermite_fast::UpdateRange(t, begin, end, *sink);
+				});
+			}
+			// frame boundary: every bucket for this t is done before the next starts
+			pool.wait();
+		}
+		gParallelUpdateTimers.emplace_back(timer.stop());
+
+		// every task has finished, so the sinks can be read from here
+		for (auto& sink : sinks) {
+			for (size_t i = 0; i < ARRAY_SIZE(dummyOut); ++i) {
+				dummyOut[i] += sink.out[i];
+			}
+		}
+	}
+}
+
+void ConcurrentSpawnExampleTimers()
+{
+#ifdef PRINT
+	cout << "ConcurrentSpawnExampleTimers" << endl;
+#endif
+	entity_registry registry;
+	{
+		default_random_engine generator;
+		uniform_real_distribution<float> distribution(0, 1);
+		for (int i = 0; i < 1400; i++)
+		{
+			registry.spawn(i % 3 ? entity_hermite::type : entity_lerp_fast::type, distribution(generator), distribution(generator), distribution(generator), distribution(generator));
+		}
+		registry.apply();
+	}
+
+	// AI/network style producers: spawn a mix of types and despawn some of
+	// their own earlier spawns, all while the update loop below is running
+	const int number_of_producers = 2;
+	const int commands_per_producer = 20000;
+	atomic<int> producers_running(number_of_producers);
+	vector<thread> producers;
+	for (int p = 0; p < number_of_producers; p++)
+	{
+		producers.emplace_back([&registry, &producers_running, p, commands_per_producer]() {
+			default_random_engine generator(p + 1);
+			uniform_real_distribution<float> distribution(0, 1);
+			const long long types[] = { entity_lerp_slow::type, entity_lerp_fast::type, entity_hermite::type, entity_hermite_fast::type };
+			vector<entity_id> mine;
+			for (int i = 0; i < commands_per_producer; i++)
+			{
+				if (!mine.empty() && distribution(generator) < 0.4f)
+				{
+					size_t pick = static_cast<size_t>(distribution(generator) * mine.size()) % mine.size();
+					registry.despawn(mine[pick]);
+					mine[pick] = mine.back();
+					mine.pop_back();
+				}
+				else
+				{
+					long long type = types[i % ARRAY_SIZE(types)];
+					mine.push_back(registry.spawn(type, distribution(generator), distribution(generator), distribution(generator), distribution(generator)));
+				}
+				if (i % 64 == 0)
+				{
+					this_thread::yield();
+				}
+			}
+			producers_running--;
+		});
+	}
+
+	SpawnReport report = {};
+	float t = 0.0f;
+	bool last_frame = false;
+	while (!last_frame)
+	{
+		// read before draining, so the final frame sees every producer's requests
+		last_frame = producers_running.load() == 0;
+		mytimer frame;
+		{
+			// frame boundary: the only place the container and stores change
+			mytimer timer;
+			report.applied += registry.apply();
+			report.apply_time += timer.stop();
+		}
+		{
+			mytimer timer;
+			for (auto &a : registry.entities()) {
+				if (*a->m_typedata != entity_lerp_fast::type && *a->m_typedata != entity_hermite_fast::type) {
+					a->Update(t);
+				}
+			}
+			entity_lerp_fast::UpdateAll(t);
+			entity_hermite_fast::UpdateAll(t);
+			report.update_time += timer.stop();
+		}
+		std::chrono::duration<double, std::ratio<1, 1000>> frame_time = frame.stop();
+		report.worst_frame = max(report.worst_frame, frame_time);
+		report.frames++;
+		t = t + 0.05f < 1.0f ? t + 0.05f : 0.0f;
+	}
+	for (auto &producer : producers)
+	{
+		producer.join();
+	}
+	report.live = registry.entities().size();
+	gConcurrentSpawnReports.push_back(report);
+}
+
+void PooledUpdateExampleTimers()
+{
+#ifdef PRINT
+	cout << "PooledUpdateExampleTimers" << endl;
+#endif
+	int number_of_lerp = 400;
+	int number_of_hermite = 1000;
+	vector<long long> create_types;
+	for (int i = 0; i < number_of_lerp; i++)
+	{
+		create_types.emplace_back(entity_lerp_slow::type);
+	}
+	for (int i = 0; i < number_of_hermite; i++)
+	{
+		create_types.emplace_back(entity_hermite::type);
+	}
+
+	{
+		// the SlowUpdateExample world, one heap object per entity
+		default_random_engine generator;
+		uniform_real_distribution<float> distribution(0, 1);
+		shuffle(create_types.begin(), create_types.end(), generator);
+
+		vector<unique_ptr<entity>> entity_vec;
+		for (auto &create_type : create_types)
+		{
+			if (create_type == entity_hermite::type)
+			{
+				unique_ptr<entity> a(create_entity_hermite(distribution(generator), distribution(generator), distribution(generator), distribution(generator)));
+				entity_vec.emplace_back(std::move(a));
+			}
+			else
+			{
+				unique_ptr<entity> a(create_entity_lerp_slow(distribution(generator), distribution(generator)));
+				entity_vec.emplace_back(std::move(a));
+			}
+		}
+
+		{
+			mytimer timer;
+			for (float t = 0.0f; t < 1.0; t += 0.05f) {
+				for (auto &a : entity_vec) {
+					a->Update(t);
+				}
+			}
+			gHeapUpdateTimers.emplace_back(timer.stop());
+		}
+		{
+			mytimer timer;
+			entity_vec.clear();
+			gHeapTeardownTimers.emplace_back(timer.stop());
+		}
+	}
+
+	{
+		// the same world, each dynamic type packed into its own pool
+		default_random_engine generator;
+		uniform_real_distribution<float> distribution(0, 1);
+		shuffle(create_types.begin(), create_types.end(), generator);
+
+		entity_arena arena;
+		vector<entity*> entity_vec;
+		for (auto &create_type : create_types)
+		{
+			if (create_type == entity_hermite::type)
+			{
+				entity_vec.push_back(create_entity_hermite(distribution(generator), distribution(generator), distribution(generator), distribution(generator), &arena));
+			}
+			else
+			{
+				entity_vec.push_back(create_entity_lerp_slow(distribution(generator), distribution(generator), &arena));
+			}
+		}
+
+		{
+			mytimer timer;
+			for (float t = 0.0f; t < 1.0; t += 0.05f) {
+				for (auto a : entity_vec) {
+					a->Update(t);
+				}
+			}
+			gArenaUpdateTimers.emplace_back(timer.stop());
+		}
+		{
+			// both pools skip their destructors, so this is a rewind per pool
+			mytimer timer;
+			arena.reset();
+			gArenaTeardownTimers.emplace_back(timer.stop());
+		}
+	}
+}
+
+void PolyCollectionUpdateExampleTimers()
+{
+#ifdef PRINT
+	cout << "PolyCollectionUpdateExampleTimers" << endl;
+#endif
+	default_random_engine generator;
+	uniform_real_distribution<float> distribution(0, 1);
+
+	int number_of_lerp = 400;
+	int number_of_hermite = 1000;
+	vector<long long> create_types;
+	for (int i = 0; i < number_of_lerp; i++)
+	{
+		create_types.emplace_back(entity_lerp_slow::type);
+	}
+	for (int i = 0; i < number_of_hermite; i++)
+	{
+		create_types.emplace_back(entity_hermite::type);
+	}
+
+	shuffle(create_types.begin(), create_types.end(), generator);
+
+	// the SlowUpdateExample world, stored by value one segment per type
+	poly_collection<entity> entity_vec;
+	for (auto &create_type : create_types)
+	{
+		if (create_type == entity_hermite::type)
+		{
+			create_entity_hermite(distribution(generator), distribution(generator), distribution(generator), distribution(generator), entity_vec);
+		}
+		else
+		{
+			create_entity_lerp_slow(distribution(generator), distribution(generator), entity_vec);
+		}
+	}
+
+	{
+		// the SlowUpdateExample loop, unchanged
+		mytimer timer;
+		for (float t = 0.0f; t < 1.0; t += 0.05f) {
+			for (auto &a : entity_vec) {
+				a->Update(t);
+			}
+		}
+		gPolyCollectionUpdateTimers.emplace_back(timer.stop());
+	}
+
+	{
+		mytimer timer;
+		for (float t = 0.0f; t < 1.0; t += 0.05f) {
+			entity_vec.for_each([t](const entity& a) { a.Update(t); });
+		}
+		gPolyCollectionForEachTimers.emplace_back(timer.stop());
+	}
+}
+
+void PrefetchSweepExampleTimers()
+{
+#ifdef PRINT
+	cout << "PrefetchSweepExampleTimers" << endl;
+#endif
+	// world sizes from cache resident to well past the last level cache
+	const size_t sizes[] = { 1400, 1 << 14, 1 << 17, 1 << 20 };
+	// (object, vtable) distances; (0, 0) is the plain loop
+	const size_t distances[][2] = { { 0, 0 }, { 8, 0 }, { 16, 0 }, { 32, 0 }, { 8, 4 }, { 16, 8 }, { 32, 16 }, { 64, 16 } };
+
+	for (auto size : sizes)
+	{
+		default_random_engine generator;
+		uniform_real_distribution<float> distribution(0, 1);
+
+		vector<unique_ptr<entity>> entity_vec;
+		for (size_t i = 0; i < size; i++)
+		{
+			if (i % 7 < 5)
+			{
+				unique_ptr<entity> a(create_entity_hermite(distribution(generator), distribution(generator), distribution(generator), distribution(generator)));
+				entity_vec.emplace_back(std::move(a));
+			}
+			else
+			{
+				unique_ptr<entity> a(create_entity_lerp_slow(distribution(generator), distribution(generator)));
+				entity_vec.emplace_back(std::move(a));
+			}
+		}
+		// iteration order no longer follows allocation order, as in a long running world
+		shuffle(entity_vec.begin(), entity_vec.end(), generator);
+
+		// fewer steps for the big worlds, the per update cost is what is reported
+		const float step = size > (1 << 16) ? 0.25f : 0.05f;
+		for (auto &d : distances)
+		{
+			size_t updates = 0;
+			mytimer timer;
+			for (float t = 0.0f; t < 1.0; t += step) {
+				if (d[0] == 0 && d[1] == 0) {
+					for (auto &a : entity_vec) {
+						a->Update(t);
+					}
+				}
+				else {
+					for (auto &a : prefetched(entity_vec, d[0], d[1])) {
+						a->Update(t);
+					}
+				}
+				updates += entity_vec.size();
+			}
+			std::chrono::duration<double, std::nano> elapsed = timer.stop();
+			PrefetchReport report = { size, d[0], d[1], elapsed.count() / updates };
+			gPrefetchSweepReports.push_back(report);
+		}
+	}
+}
+
+void InterleavedUpdateExampleTimers()
+{
+#ifdef PRINT
+	cout << "InterleavedUpdateExampleTimers" << endl;
+#endif
+	if (!interleaved_update_supported())
+	{
+		return;
+	}
+	// DRAM sized worlds, where every entity and vptr load is a miss
+	const size_t sizes[] = { 1 << 17, 1 << 20 };
+	const size_t groups[] = { 0, 2, 4, 8, 16, 32 };
+
+	for (auto size : sizes)
+	{
+		default_random_engine generator;
+		uniform_real_distribution<float> distribution(0, 1);
+
+		vector<unique_ptr<entity>> entity_vec;
+		for (size_t i = 0; i < size; i++)
+		{
+			if (i % 7 < 5)
+			{
+				unique_ptr<entity> a(create_entity_hermite(distribution(generator), distribution(generator), distribution(generator), distribution(generator)));
+				entity_vec.emplace_back(std::move(a));
+			}
+			else
+			{
+				unique_ptr<entity> a(create_entity_lerp_slow(distribution(generator), distribution(generator)));
+				entity_vec.emplace_back(std::move(a));
+			}
+		}
+		shuffle(entity_vec.begin(), entity_vec.end(), generator);
+
+		double plain_ns = 0.0;
+		for (auto group : groups)
+		{
+			size_t updates = 0;
+			mytimer timer;
+			for (float t = 0.0f; t < 1.0; t += 0.25f) {
+				if (group == 0) {
+					for (auto &a : entity_vec) {
+						a->Update(t);
+					}
+				}
+				else {
+					interleaved_update(entity_vec, group, t);
+				}
+				updates += entity_vec.size();
+			}
+			std::chrono::duration<double, std::nano> elapsed = timer.stop();
+			InterleaveReport report = { size, group, elapsed.count() / updates, 1.0 };
+			if (group == 0) {
+				plain_ns = report.ns_per_update;
+			}
+			report.gain = plain_ns / report.ns_per_update;
+			gInterleavedUpdateReports.push_back(report);
+		}
+	}
 }
+
+// One frame of store outputs as the consumers see it.
+struct PipelineFrame
+{
+	uint64_t frame;
+	float t;
+	vector<float> lerp;
+	vector<float> hermite;
+};
+
+void PipelinedFrameExampleTimers()
+{
+#ifdef PRINT
+	cout << "PipelinedFrameExampleTimers" << endl;
 #endif
+	default_random_engine generator;
+	uniform_real_distribution<float> distribution(0, 1);
+
+	vector<unique_ptr<entity>> entity_vec;
+	for (int i = 0; i < 400 * 64; i++)
+	{
+		unique_ptr<entity> a(create_entity_lerp_fast(distribution(generator), distribution(generator)));
+		entity_vec.emplace_back(std::move(a));
+	}
+	for (int i = 0; i < 1000 * 64; i++)
+	{
+		unique_ptr<entity> a(create_entity_hermite_fast(distribution(generator), distribution(generator), distribution(generator), distribution(generator)));
+		entity_vec.emplace_back(std::move(a));
+	}
+
+	const int frames = 200;
+	const size_t consumers = 2;
+	const size_t buffer_counts[] = { 1, 2, 3 };
+	for (auto buffers : buffer_counts)
+	{
+		frame_pipeline<PipelineFrame> pipeline(buffers, consumers);
+		// per consumer, when it finished each frame
+		vector<vector<std::chrono::time_point<std::chrono::high_resolution_clock>>> finished(consumers, vector<std::chrono::time_point<std::chrono::high_resolution_clock>>(frames));
+		vector<std::chrono::time_point<std::chrono::high_resolution_clock>> started(frames);
+
+		mytimer timer;
+		vector<std::thread> threads;
+		// each consumer's result, read once it has been joined
+		float consumerOut[consumers] = {};
+		// render: reduce the frame to something it would draw
+		threads.emplace_back([&pipeline, &finished, &consumerOut, frames]() {
+			float sum = 0.0f;
+			for (uint64_t n = 1; n <= static_cast<uint64_t>(frames); ++n) {
+				const PipelineFrame& frame = pipeline.begin_read(0, n);
+				assert(frame.frame == n);
+				for (auto v : frame.lerp) {
+					sum += v;
+				}
+				for (auto v : frame.hermite) {
+					sum += v;
+				}
+				pipeline.end_read(0, n);
+				finished[0][n - 1] = std::chrono::high_resolution_clock::now();
+			}
+			consumerOut[0] = sum;
+		});
+		// replication: quantise the frame and count what changed since the last one sent
+		threads.emplace_back([&pipeline, &finished, &consumerOut, frames]() {
+			vector<short> sent;
+			size_t changed = 0;
+			for (uint64_t n = 1; n <= static_cast<uint64_t>(frames); ++n) {
+				const PipelineFrame& frame = pipeline.begin_read(1, n);
+				sent.resize(frame.lerp.size() + frame.hermite.size());
+				size_t i = 0;
+				for (auto v : frame.lerp) {
+					const short q = static_cast<short>(v * 1024.0f);
+					changed += q != sent[i];
+					sent[i++] = q;
+				}
+				for (auto v : frame.hermite) {
+					const short q = static_cast<short>(v * 1024.0f);
+					changed += q != sent[i];
+					sent[i++] = q;
+				}
+				pipeline.end_read(1, n);
+				finished[1][n - 1] = std::chrono::high_resolution_clock::now();
+			}
+			consumerOut[1] = static_cast<float>(changed);
+		});
+
+		// the simulation runs here, at most buffers frames ahead of the slower consumer
+		for (uint64_t n = 1; n <= static_cast<uint64_t>(frames); ++n) {
+			const float t = static_cast<float>(n % 20) * 0.05f;
+			started[n - 1] = std::chrono::high_resolution_clock::now();
+			PipelineFrame& frame = pipeline.begin_write(n);
+			frame.frame = n;
+			frame.t = t;
+			frame.lerp.resize(entity_lerp_fast::Count());
+			frame.hermite.resize(entity_hermite_fast::Count());
+			// one sample per entity: the stores write straight into the frame's arrays
+			entity_lerp_fast::UpdateAllSamples(&t, 1, frame.lerp.data());
+			entity_hermite_fast::UpdateAllSamples(&t, 1, frame.hermite.data());
+			pipeline.end_write(n);
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		std::chrono::duration<double> elapsed = timer.stop();
+		for (auto out : consumerOut) {
+			dummyOut[dummyOutIndex++ % ARRAY_SIZE(dummyOut)] = out;
+		}
+
+		// a frame's latency runs from the simulation starting it to the last consumer finishing it
+		PipelineReport report = {};
+		report.buffers = buffers;
+		report.frames = frames;
+		report.frames_per_second = frames / elapsed.count();
+		for (int n = 0; n < frames; ++n) {
+			auto done = finished[0][n];
+			for (size_t c = 1; c < consumers; ++c) {
+				done = max(done, finished[c][n]);
+			}
+			const std::chrono::duration<double, std::ratio<1, 1000>> latency = done - started[n];
+			report.mean_latency += latency / frames;
+			report.worst_latency = max(report.worst_latency, latency);
+		}
+		gPipelinedFrameReports.push_back(report);
+	}
+}
+
+void EcsComparisonExampleTimers()
+{
+#ifdef PRINT
+	cout << "EcsComparisonExampleTimers" << endl;
+#endif
+	default_random_engine generator;
+	const vector<entity_desc> world = describe_world(400 * 64, entity_lerp_slow::type, 1000 * 64, entity_hermite::type, generator);
+	// the same world with its types moved to the batch stores, for the type-compare loop
+	vector<entity_desc> fast_world = world;
+	for (auto &desc : fast_world)
+	{
+		desc.type = desc.type == entity_lerp_slow::type ? entity_lerp_fast::type : entity_hermite_fast::type;
+	}
+	// which live entity each despawn removes, shared by every backend
+	vector<size_t> despawn_picks(world.size() / 2);
+	for (auto &pick : despawn_picks)
+	{
+		pick = generator();
+	}
+
+	// both hierarchy strategies allocate from an arena, so their footprint can be counted
+	for (int strategy = 0; strategy < 2; strategy++)
+	{
+		const vector<entity_desc>& desc = strategy == 0 ? world : fast_world;
+		BackendReport report = {};
+		report.backend = strategy == 0 ? "virtual" : "type-compare";
+		report.entities = desc.size();
+
+		entity_arena arena;
+		vector<entity*> entity_vec;
+		{
+			mytimer timer;
+			for (auto &d : desc) {
+				entity_vec.push_back(create_entity(d, &arena));
+			}
+			report.spawn_time = timer.stop();
+		}
+		report.bytes = arena.bytes() + entity_vec.capacity() * sizeof(entity*)
+			+ entity_lerp_fast::ParamBytes() + entity_hermite_fast::ParamBytes();
+		{
+			mytimer timer;
+			for (float t = 0.0f; t < 1.0; t += 0.05f) {
+				if (strategy == 0) {
+					for (auto a : entity_vec) {
+						a->Update(t);
+					}
+				}
+				else {
+					for (auto a : entity_vec) {
+						if (*a->m_typedata != entity_lerp_fast::type && *a->m_typedata != entity_hermite_fast::type) {
+							a->Update(t);
+						}
+					}
+					entity_lerp_fast::UpdateAll(t);
+					entity_hermite_fast::UpdateAll(t);
+				}
+			}
+			report.update_time = timer.stop();
+		}
+		{
+			mytimer timer;
+			for (auto pick : despawn_picks) {
+				const size_t i = pick % entity_vec.size();
+				arena.destroy(entity_vec[i]);
+				entity_vec[i] = entity_vec.back();
+				entity_vec.pop_back();
+			}
+			report.despawn_time = timer.stop();
+		}
+		gEcsComparisonReports.push_back(report);
+		arena.reset();
+	}
+
+	{
+		BackendReport report = {};
+		report.backend = "archetype";
+		report.entities = world.size();
+
+		ecs_world ecs;
+		vector<ecs_entity> ids;
+		{
+			mytimer timer;
+			for (auto &d : world) {
+				ids.push_back(ecs.spawn(d));
+			}
+			report.spawn_time = timer.stop();
+		}
+		report.bytes = ecs.bytes() + ids.capacity() * sizeof(ecs_entity);
+		{
+			mytimer timer;
+			for (float t = 0.0f; t < 1.0; t += 0.05f) {
+				ecs.update_lerp(t);
+				ecs.update_hermite(t);
+			}
+			report.update_time = timer.stop();
+		}
+		{
+			mytimer timer;
+			for (auto pick : despawn_picks) {
+				const size_t i = pick % ids.size();
+				ecs.despawn(ids[i]);
+				ids[i] = ids.back();
+				ids.pop_back();
+			}
+			report.despawn_time = timer.stop();
+		}
+		assert(ecs.size() == ids.size());
+		gEcsComparisonReports.push_back(report);
+	}
+}
 
 int main()
 {
@@ -288,6 +1322,16 @@ int main()
 #ifdef __GNUC__
 	MethodPointerUpdateExampleTimers();
 #endif
+	MultiSampleUpdateExampleTimers();
+	PackedUpdateExampleTimers();
+	ParallelUpdateExampleTimers();
+	ConcurrentSpawnExampleTimers();
+	PooledUpdateExampleTimers();
+	PolyCollectionUpdateExampleTimers();
+	PrefetchSweepExampleTimers();
+	InterleavedUpdateExampleTimers();
+	PipelinedFrameExampleTimers();
+	EcsComparisonExampleTimers();
 
 	for (auto a : dummyOut)
 	{
@@ -311,7 +1355,108 @@ int main()
 	{
 		cout << "gMethodPointerUpdateExampleTimers ms " << t.count() << endl;
 	}
+	for (auto & t : gMethodPointerGetFunctionPointerTimers)
+	{
+		cout << "gMethodPointerGetFunctionPointerTimers ms " << t.count() << endl;
+	}
+	for (auto & t : gMethodPointerSlotProbeTimers)
+	{
+		cout << "gMethodPointerSlotProbeTimers ms " << t.count() << endl;
+	}
+	for (auto & t : gMethodPointerGatherTimers)
+	{
+		cout << "gMethodPointerGatherTimers ms " << t.count() << endl;
+	}
 #endif
+	for (auto & t : gMultiSampleStepTimers)
+	{
+		cout << "gMultiSampleStepTimers ms " << t.count() << endl;
+	}
+	for (auto & t : gMultiSampleBatchTimers)
+	{
+		cout << "gMultiSampleBatchTimers ms " << t.count() << endl;
+	}
+	for (auto & r : gPackedUpdateReports)
+	{
+		cout << "gPackedUpdateReports " << param_format_name(r.format)
+			<< " ms " << r.time.count()
+			<< " UpdateAll ms " << r.update_all_time.count()
+			<< " bytes " << r.bytes
+			<< " lerp max " << r.lerp_error.max_abs << " rms " << r.lerp_error.rms
+			<< " hermite max " << r.hermite_error.max_abs << " rms " << r.hermite_error.rms << endl;
+	}
+	for (auto & t : gParallelSerialTimers)
+	{
+		cout << "gParallelSerialTimers ms " << t.count() << endl;
+	}
+	for (auto & t : gParallelUpdateTimers)
+	{
+		cout << "gParallelUpdateTimers ms " << t.count() << " workers " << gParallelWorkers << endl;
+	}
+	for (auto & r : gConcurrentSpawnReports)
+	{
+		cout << "gConcurrentSpawnReports frames " << r.frames
+			<< " applied " << r.applied
+			<< " live " << r.live
+			<< " apply ms " << r.apply_time.count()
+			<< " update ms " << r.update_time.count()
+			<< " worst frame ms " << r.worst_frame.count() << endl;
+	}
+	for (auto & t : gHeapUpdateTimers)
+	{
+		cout << "gHeapUpdateTimers ms " << t.count() << endl;
+	}
+	for (auto & t : gHeapTeardownTimers)
+	{
+		cout << "gHeapTeardownTimers ms " << t.count() << endl;
+	}
+	for (auto & t : gArenaUpdateTimers)
+	{
+		cout << "gArenaUpdateTimers ms " << t.count() << endl;
+	}
+	for (auto & t : gArenaTeardownTimers)
+	{
+		cout << "gArenaTeardownTimers ms " << t.count() << endl;
+	}
+	for (auto & t : gPolyCollectionUpdateTimers)
+	{
+		cout << "gPolyCollectionUpdateTimers ms " << t.count() << endl;
+	}
+	for (auto & t : gPolyCollectionForEachTimers)
+	{
+		cout << "gPolyCollectionForEachTimers ms " << t.count() << endl;
+	}
+	for (auto & r : gPrefetchSweepReports)
+	{
+		cout << "gPrefetchSweepReports entities " << r.entities
+			<< " object " << r.object_distance
+			<< " vtable " << r.vtable_distance
+			<< " ns/update " << r.ns_per_update << endl;
+	}
+	for (auto & r : gInterleavedUpdateReports)
+	{
+		cout << "gInterleavedUpdateReports entities " << r.entities
+			<< " group " << r.group
+			<< " ns/update " << r.ns_per_update
+			<< " gain " << r.gain << endl;
+	}
+	for (auto & r : gPipelinedFrameReports)
+	{
+		cout << "gPipelinedFrameReports buffers " << r.buffers
+			<< " frames " << r.frames
+			<< " frames/s " << r.frames_per_second
+			<< " mean latency ms " << r.mean_latency.count()
+			<< " worst latency ms " << r.worst_latency.count() << endl;
+	}
+	for (auto & r : gEcsComparisonReports)
+	{
+		cout << "gEcsComparisonReports " << r.backend
+			<< " entities " << r.entities
+			<< " bytes " << r.bytes
+			<< " spawn ms " << r.spawn_time.count()
+			<< " update ms " << r.update_time.count()
+			<< " despawn ms " << r.despawn_time.count() << endl;
+	}
 	return 0;
 }
 
@@ -0,0 +1,170 @@
+// ecs.cpp : archetype tables and the lerp and hermite systems.
+//
+
+#include "stdafx.h"
+#include "ecs.h"
+#include "lerp.h"
+#include "hermite.h"
+
+#include <assert.h>
+#include <iostream>
+
+using namespace std;
+
+#define ARRAY_SIZE(array) (sizeof((array))/sizeof((array[0])))
+extern float dummyOut[100];
+extern int dummyOutIndex;
+
+// the same kernels the virtual entities evaluate
+float lerp(float t, float s, float d);
+float hermite(float t, float p1, float p2, float n1, float n2);
+
+const uint32_t ecs_world::dead;
+
+ecs_world::archetype& ecs_world::archetype_for(unsigned mask, uint32_t& index)
+{
+	for (index = 0; index < m_archetypes.size(); ++index)
+	{
+		if (m_archetypes[index]->mask == mask)
+		{
+			return *m_archetypes[index];
+		}
+	}
+	archetype* a = new archetype();
+	a->mask = mask;
+	m_archetypes.emplace_back(a);
+	return *a;
+}
+
+ecs_entity ecs_world::spawn(unsigned mask, const lerp_component& lerp, const hermite_component& hermite)
+{
+	uint32_t index;
+	archetype& a = archetype_for(mask, index);
+	ecs_entity e;
+	if (!m_free_ids.empty())
+	{
+		e = m_free_ids.back();
+		m_free_ids.pop_back();
+	}
+	else
+	{
+		e = static_cast<ecs_entity>(m_locations.size());
+		m_locations.emplace_back();
+	}
+	location loc = { index, static_cast<uint32_t>(a.entities.size()) };
+	m_locations[e] = loc;
+	a.entities.push_back(e);
+	if (mask & ecs_lerp)
+	{
+		a.lerps.push_back(lerp);
+	}
+	if (mask & ecs_hermite)
+	{
+		a.hermites.push_back(hermite);
+	}
+	m_live++;
+	return e;
+}
+
+ecs_entity ecs_world::spawn(const entity_desc& desc)
+{
+	const float* p = desc.params;
+	if (desc.type == entity_lerp_slow::type || desc.type == entity_lerp_fast::type)
+	{
+		lerp_component lerp = { p[0], p[1] };
+		return spawn(ecs_lerp, lerp, hermite_component());
+	}
+	assert(desc.type == entity_hermite::type || desc.type == entity_hermite_fast::type);
+	hermite_component hermite = { p[0], p[1], p[2], p[3] };
+	return spawn(ecs_hermite, lerp_component(), hermite);
+}
+
+void ecs_world::despawn(ecs_entity e)
+{
+	location& loc = m_locations[e];
+	assert(loc.archetype != dead);
+	archetype& a = *m_archetypes[loc.archetype];
+	const uint32_t last = static_cast<uint32_t>(a.entities.size() - 1);
+	if (loc.row != last)
+	{
+		// swap-and-pop every column, then point the moved entity at its new row
+		const ecs_entity moved = a.entities[last];
+		a.entities[loc.row] = moved;
+		if (a.mask & ecs_lerp)
+		{
+			a.lerps[loc.row] = a.lerps[last];
+		}
+		if (a.mask & ecs_hermite)
+		{
+			a.hermites[loc.row] = a.hermites[last];
+		}
+		m_locations[moved].row = loc.row;
+	}
+	a.entities.pop_back();
+	if (a.mask & ecs_lerp)
+	{
+		a.lerps.pop_back();
+	}
+	if (a.mask & ecs_hermite)
+	{
+		a.hermites.pop_back();
+	}
+	loc.archetype = dead;
+	m_free_ids.push_back(e);
+	m_live--;
+}
+
+void ecs_world::update_lerp(float t) const
+{
+	for (auto& a : m_archetypes)
+	{
+		if (!(a->mask & ecs_lerp))
+		{
+			continue;
+		}
+		for (auto& c : a->lerps)
+		{
+#ifdef PRINT
+			cout << "ecs_lerp ";
+			cout << lerp(t, c.s, c.d);
+			cout << endl;
+#endif
+			dummyOut[dummyOutIndex % ARRAY_SIZE(dummyOut)] = lerp(t, c.s, c.d);
+			dummyOutIndex++;
+		}
+	}
+}
+
+void ecs_world::update_hermite(float t) const
+{
+	for (auto& a : m_archetypes)
+	{
+		if (!(a->mask & ecs_hermite))
+		{
+			continue;
+		}
+		for (auto& c : a->hermites)
+		{
+#ifdef PRINT
+			cout << "ecs_hermite ";
+			cout << hermite(t, c.p1, c.p2, c.n1, c.n2);
+			cout << endl;
+#endif
+			dummyOut[dummyOutIndex % ARRAY_SIZE(dummyOut)] = hermite(t, c.p1, c.p2, c.n1, c.n2);
+			dummyOutIndex++;
+		}
+	}
+}
+
+size_t ecs_world::bytes() const
+{
+	size_t total = m_locations.capacity() * sizeof(location) + m_free_ids.capacity() * sizeof(ecs_entity);
+	for (auto& a : m_archetypes)
+	{
+		total += sizeof(archetype)
+			+ a->entities.capacity() * sizeof(ecs_entity)
+			+ a->lerps.capacity() * sizeof(lerp_component)
+			+ a->hermites.capacity() * sizeof(hermite_component);
+	}
+	return total;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "world.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// An entity-component alternative to the virtual hierarchy. There are no
+// entity objects: an entity is an id, its components live in column arrays
+// of the archetype table for its exact component set, and each system walks
+// the columns of every archetype that has the components it reads.
+
+typedef uint32_t ecs_entity;
+
+enum ecs_component : unsigned
+{
+	ecs_lerp = 1u << 0,
+	ecs_hermite = 1u << 1,
+};
+
+struct lerp_component
+{
+	float s;
+	float d;
+};
+
+struct hermite_component
+{
+	float p1;
+	float p2;
+	float n1;
+	float n2;
+};
+
+class ecs_world
+{
+public:
+	ecs_world() {}
+	ecs_world(const ecs_world&) = delete;
+	ecs_world& operator=(const ecs_world&) = delete;
+
+	// Add an entity with the components in mask; components not in mask are ignored.
+	ecs_entity spawn(unsigned mask, const lerp_component& lerp, const hermite_component& hermite);
+	// The component set for a world description entry: lerp types get a
+	// lerp_component, hermite types a hermite_component.
+	ecs_entity spawn(const entity_desc& desc);
+	// Remove an entity. The last row of its archetype moves into its place.
+	void despawn(ecs_entity e);
+
+	// Systems: evaluate every entity with the component at t.
+	void update_lerp(float t) const;
+	void update_hermite(float t) const;
+
+	size_t size() const { return m_live; }
+	size_t archetypes() const { return m_archetypes.size(); }
+	// Bytes reserved by the tables and the id map.
+	size_t bytes() const;
+
+private:
+	struct archetype
+	{
+		unsigned mask;
+		std::vector<ecs_entity> entities; // row -> id, to fix up a moved row on despawn
+		std::vector<lerp_component> lerps;
+		std::vector<hermite_component> hermites;
+	};
+
+	struct location
+	{
+		uint32_t archetype;
+		uint32_t row;
+	};
+
+	static const uint32_t dead = ~0u;
+
+	archetype& archetype_for(unsigned mask, uint32_t& index);
+
+	std::vector<std::unique_ptr<archetype>> m_archetypes;
+	std::vector<location> m_locations; // indexed by id
+	std::vector<ecs_entity> m_free_ids;
+	size_t m_live = 0;
+};
@@ -1,5 +1,14 @@
 #pragma once
 
+// A private stand-in for dummyOut, for updates that run on other threads.
+// Each parallel chunk writes its own, and main adds them up once the chunks
+// are done.
+struct output_sink
+{
+	float out[100];
+	int index;
+};
+
 class entity
 {
 public:
@@ -9,4 +18,6 @@ public:
 	virtual void Update(float t) const = 0;
 	virtual int GetType() const = 0;
 	virtual ~entity() {}
+	// Update, writing to sink instead of dummyOut.
+	virtual void UpdateInto(float t, output_sink& sink) const = 0;
 };
@@ -5,6 +5,8 @@
 
 #include "entity.h"
 #include "hermite.h"
+#include "arena.h"
+#include "poly_collection.h"
 
 #include <vector>
 #include <memory>
@@ -65,9 +67,300 @@ public:
 		dummyOut[dummyOutIndex % ARRAY_SIZE(dummyOut)] = hermite(t, m_p1, m_p2, m_n1, m_n2);
 		dummyOutIndex++;
 	}
+
+	void UpdateInto(float t, output_sink& sink) const override
+	{
+		sink.out[sink.index % ARRAY_SIZE(sink.out)] = hermite(t, m_p1, m_p2, m_n1, m_n2);
+		sink.index++;
+	}
 };
 
-entity_hermite* create_entity_hermite(float p1, float p2, float n1, float n2)
+// nothing but four floats to tear down
+template <>
+struct arena_skip_destructor<entity_hermite_impl> : std::true_type {};
+
+entity_hermite* create_entity_hermite(float p1, float p2, float n1, float n2, entity_arena* arena)
 {
+	if (arena)
+	{
+		return arena->create<entity_hermite_impl>(p1, p2, n1, n2);
+	}
 	return new entity_hermite_impl(p1, p2, n1, n2);
-}
\ No newline at end of file
+}
+
+entity_hermite* create_entity_hermite(float p1, float p2, float n1, float n2, poly_collection<entity>& collection)
+{
+	return &collection.emplace<entity_hermite_impl>(p1, p2, n1, n2);
+}
+
+struct HermiteParams
+{
+	float p1;
+	float p2;
+	float n1;
+	float n2;
+};
+
+// The four basis weights only depend on t, so a batch computes them once per
+// sample rather than once per entity per sample.
+struct HermiteBasis
+{
+	float h1;
+	float h2;
+	float h3;
+	float h4;
+};
+
+static HermiteBasis hermite_basis(float t)
+{
+	float t2 = t*t*t;
+	float t3 = t2*t;
+	HermiteBasis b;
+	b.h1 = 2*t3 - 3*t2 + 1;
+	b.h2 = -2*t3 + 3*t2;
+	b.h3 = t3 - 2 * t2 + t;
+	b.h4 = t3 - t2;
+	return b;
+}
+
+const long long entity_hermite_fast::type = 4LL;
+
+static std::vector<HermiteParams> s_hermites;
+class entity_hermite_fast_impl;
+// owner of each s_hermites row, so any entity can be removed by swapping in the last row
+static std::vector<entity_hermite_fast_impl*> s_owners;
+
+// Optional 16 bit copy of s_hermites, rebuilt lazily after the store changes.
+static param_format s_format = param_format::fp32;
+static packed_store<4> s_packed;
+static bool s_packed_dirty = true;
+
+static const packed_store<4>& packed_hermites()
+{
+	static_assert(sizeof(HermiteParams) == 4 * sizeof(float), "HermiteParams is packed as four floats");
+	if (s_packed_dirty)
+	{
+		s_packed.pack(reinterpret_cast<const float*>(s_hermites.data()), s_hermites.size(), s_format);
+		s_packed_dirty = false;
+	}
+	return s_packed;
+}
+
+class entity_hermite_fast_impl : public entity_hermite_fast
+{
+	size_t m_slot; // row of this entity in the hermite store
+public:
+	const static int type = 4;
+	entity_hermite_fast_impl(float p1, float p2, float n1, float n2)
+	{
+		m_slot = s_hermites.size();
+		s_hermites.push_back({ p1, p2, n1, n2 });
+		s_owners.push_back(this);
+		s_packed_dirty = true;
+	}
+	virtual ~entity_hermite_fast_impl()
+	{
+		const size_t last = s_hermites.size() - 1;
+		if (m_slot != last)
+		{
+			s_hermites[m_slot] = s_hermites[last];
+			s_owners[m_slot] = s_owners[last];
+			s_owners[m_slot]->m_slot = m_slot;
+		}
+		s_hermites.pop_back();
+		s_owners.pop_back();
+		s_packed_dirty = true;
+	}
+
+	int GetType() const override
+	{
+		return type;
+	}
+
+	virtual void Update(float t) const override
+	{
+		assert(0); // don't call. 
+	}
+
+	void UpdateInto(float t, output_sink& sink) const override
+	{
+		assert(0); // don't call. 
+	}
+};
+
+// out and index are dummyOut and dummyOutIndex for UpdateAll, or a chunk's
+// output_sink for UpdateRange
+static void update_range_packed(float t, size_t begin, size_t end, float (&out)[100], int& index)
+{
+	const packed_store<4>& store = packed_hermites();
+	float h[4][packed_lanes];
+	for (size_t b = begin / packed_lanes; b * packed_lanes < end; ++b)
+	{
+		const size_t first = b * packed_lanes;
+		const size_t lanes = store.decode(s_format, b, h);
+		const size_t lo = begin > first ? begin - first : 0;
+		const size_t hi = end - first < lanes ? end - first : lanes;
+		// every lane at once, in registers, before the per-entity stores
+		float r[packed_lanes];
+		for (size_t l = 0; l < packed_lanes; ++l)
+		{
+			r[l] = hermite(t, h[0][l], h[1][l], h[2][l], h[3][l]);
+		}
+		for (size_t l = lo; l < hi; ++l)
+		{
+			out[index % ARRAY_SIZE(out)] = r[l];
+			index++;
+		}
+	}
+}
+
+static void update_range(float t, size_t begin, size_t end, float (&out)[100], int& index)
+{
+	if (s_format != param_format::fp32)
+	{
+		update_range_packed(t, begin, end, out, index);
+		return;
+	}
+	for (size_t i = begin; i < end; ++i)
+	{
+		const HermiteParams& h = s_hermites[i];
+#ifdef PRINT
+		cout << "fast_hermite ";
+		cout << hermite(t, h.p1, h.p2, h.n1, h.n2);
+		cout << endl;
+#endif
+		out[index % ARRAY_SIZE(out)] = hermite(t, h.p1, h.p2, h.n1, h.n2);
+		index++;
+	}
+}
+
+void entity_hermite_fast::UpdateAll(float t)
+{
+	update_range(t, 0, s_hermites.size(), dummyOut, dummyOutIndex);
+}
+
+void entity_hermite_fast::UpdateRange(float t, size_t begin, size_t end, output_sink& sink)
+{
+	update_range(t, begin, end, sink.out, sink.index);
+}
+
+void entity_hermite_fast::UpdateAllSamples(const float* ts, size_t count, float* out)
+{
+	// Samples are processed in blocks so the basis table stays on the stack;
+	// a typical bake (20 samples) is a single block.
+	const size_t block = 32;
+	HermiteBasis basis[block];
+	for (size_t first = 0; first < count; first += block)
+	{
+		const size_t n = count - first < block ? count - first : block;
+		for (size_t i = 0; i < n; ++i)
+		{
+			basis[i] = hermite_basis(ts[first + i]);
+		}
+		float* row = out + first;
+		if (s_format != param_format::fp32)
+		{
+			// decode a block of entities at a time, then evaluate each from registers
+			const packed_store<4>& store = packed_hermites();
+			float h[4][packed_lanes];
+			for (size_t b = 0; b < store.blocks.size(); ++b)
+			{
+				const size_t lanes = store.decode(s_format, b, h);
+				// samples outer and lanes inner, so each sample is one SIMD
+				// evaluation of the whole block
+				for (size_t i = 0; i < n; ++i)
+				{
+					float r[packed_lanes];
+					for (size_t l = 0; l < packed_lanes; ++l)
+					{
+						r[l] = basis[i].h1*h[0][l] + basis[i].h2*h[1][l] + basis[i].h3*h[2][l] + basis[i].h4*h[3][l];
+					}
+					for (size_t l = 0; l < lanes; ++l)
+					{
+						row[l * count + i] = r[l];
+					}
+				}
+				row += lanes * count;
+			}
+			continue;
+		}
+		// whole blocks of packed_lanes entities the same way, so the formats
+		// differ only in what they load; the remainder one at a time
+		const size_t entities = s_hermites.size();
+		const HermiteParams* params = s_hermites.data();
+		size_t e = 0;
+		for (; e + packed_lanes <= entities; e += packed_lanes)
+		{
+			for (size_t i = 0; i < n; ++i)
+			{
+				float r[packed_lanes];
+				for (size_t l = 0; l < packed_lanes; ++l)
+				{
+					const HermiteParams& h = params[e + l];
+					r[l] = basis[i].h1*h.p1 + basis[i].h2*h.p2 + basis[i].h3*h.n1 + basis[i].h4*h.n2;
+				}
+				for (size_t l = 0; l < packed_lanes; ++l)
+				{
+					row[l * count + i] = r[l];
+				}
+			}
+			row += packed_lanes * count;
+		}
+		for (; e < entities; ++e)
+		{
+			const HermiteParams& h = params[e];
+			const float p1 = h.p1;
+			const float p2 = h.p2;
+			const float n1 = h.n1;
+			const float n2 = h.n2;
+			for (size_t i = 0; i < n; ++i)
+			{
+				row[i] = basis[i].h1*p1 + basis[i].h2*p2 + basis[i].h3*n1 + basis[i].h4*n2;
+			}
+			row += count;
+		}
+	}
+}
+
+size_t entity_hermite_fast::Count()
+{
+	return s_hermites.size();
+}
+
+void entity_hermite_fast::SetParamFormat(param_format format)
+{
+	s_format = format;
+	s_packed_dirty = true;
+}
+
+void entity_hermite_fast::PackParams()
+{
+	if (s_format != param_format::fp32)
+	{
+		packed_hermites();
+	}
+}
+
+param_format entity_hermite_fast::ParamFormat()
+{
+	return s_format;
+}
+
+size_t entity_hermite_fast::ParamBytes()
+{
+	return s_format == param_format::fp32 ? s_hermites.size() * sizeof(HermiteParams) : packed_hermites().bytes();
+}
+
+entity_hermite_fast* create_entity_hermite_fast(float p1, float p2, float n1, float n2, entity_arena* arena)
+{
+	if (arena)
+	{
+		return arena->create<entity_hermite_fast_impl>(p1, p2, n1, n2);
+	}
+	return new entity_hermite_fast_impl(p1, p2, n1, n2);
+}
+
+entity_hermite_fast* create_entity_hermite_fast(float p1, float p2, float n1, float n2, poly_collection<entity>& collection)
+{
+	return &collection.emplace<entity_hermite_fast_impl>(p1, p2, n1, n2);
+}
@@ -1,5 +1,10 @@
 #pragma once
 #include "entity.h"
+#include "packed.h"
+#include <cstddef>
+
+class entity_arena;
+template <class Base> class poly_collection;
 
 class entity_hermite : public entity
 {
@@ -11,4 +16,34 @@ public:
 	virtual void Update(float t) const override = 0;
 };
 
-entity_hermite* create_entity_hermite(float p1, float p2, float n1, float n2);
\ No newline at end of file
+class entity_hermite_fast : public entity
+{
+public:
+	const static long long type;
+	entity_hermite_fast() :entity(&type) {}
+
+	virtual int GetType() const override = 0;
+	virtual void Update(float t) const override = 0;
+	static void UpdateAll(float t);
+	// Update entities [begin, end) of the store, so a frame can be split into chunks.
+	// Results go to sink rather than dummyOut, so chunks can run on any thread.
+	static void UpdateRange(float t, size_t begin, size_t end, output_sink& sink);
+	// Evaluate every entity at each of the count times in ts in one sweep.
+	// out is an entities-by-samples matrix, one row of count floats per entity.
+	static void UpdateAllSamples(const float* ts, size_t count, float* out);
+	static size_t Count();
+	// Select the parameter storage the UpdateAll kernels read from.
+	static void SetParamFormat(param_format format);
+	// Rebuild a stale packed copy now, so concurrent UpdateRange calls only read.
+	static void PackParams();
+	static param_format ParamFormat();
+	static size_t ParamBytes();
+};
+
+// With an arena the entity lives in that arena's pool for its type and is
+// released through the arena; without one it is a plain heap object.
+entity_hermite* create_entity_hermite(float p1, float p2, float n1, float n2, entity_arena* arena = nullptr);
+entity_hermite_fast* create_entity_hermite_fast(float p1, float p2, float n1, float n2, entity_arena* arena = nullptr);
+// Construct the entity by value in the collection's segment for its type.
+entity_hermite* create_entity_hermite(float p1, float p2, float n1, float n2, poly_collection<entity>& collection);
+entity_hermite_fast* create_entity_hermite_fast(float p1, float p2, float n1, float n2, poly_collection<entity>& collection);
@@ -0,0 +1,16 @@
+#pragma once
+#include "entity.h"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Interleaved execution of the virtual Update loop with C++20 coroutines.
+// Each of group coroutines walks its own slice of the entities. Before
+// touching an entity it prefetches the object and suspends, so by the time it
+// is resumed to make the call the object (and so its vptr) is in cache. A
+// round-robin scheduler keeps group misses in flight at once instead of one.
+// Returns false when interleave.cpp was built without coroutine support, in
+// which case interleaved_update is the plain loop.
+bool interleaved_update_supported();
+void interleaved_update(const std::vector<std::unique_ptr<entity>>& entities, size_t group, float t);
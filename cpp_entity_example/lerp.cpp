@@ -4,6 +4,8 @@
 #include "stdafx.h"
 #include "entity.h"
 #include "lerp.h"
+#include "arena.h"
+#include "poly_collection.h"
 
 
 #include <vector>
@@ -55,8 +57,18 @@ public:
 		dummyOut[dummyOutIndex % ARRAY_SIZE(dummyOut)] = lerp(t, m_s, m_d);
 		dummyOutIndex++;
 	}
+
+	void UpdateInto(float t, output_sink& sink) const override
+	{
+		sink.out[sink.index % ARRAY_SIZE(sink.out)] = lerp(t, m_s, m_d);
+		sink.index++;
+	}
 };
 
+// nothing but two floats to tear down
+template <>
+struct arena_skip_destructor<entity_lerp_slow_impl> : std::true_type {};
+
 struct Pos
 {
 	float x;
@@ -67,17 +79,98 @@ const long long entity_lerp_fast::type = 2LL;
 
 
 static std::vector<Pos> s_positions;
+// owner of each s_positions row, so any entity can be removed by swapping in the last row
+static std::vector<entity_lerp_fast_impl*> s_owners;
+
+// Optional 16 bit copy of s_positions, rebuilt lazily after the store changes.
+static param_format s_format = param_format::fp32;
+static packed_store<2> s_packed;
+static bool s_packed_dirty = true;
+
+static const packed_store<2>& packed_positions()
+{
+	static_assert(sizeof(Pos) == 2 * sizeof(float), "Pos is packed as two floats");
+	if (s_packed_dirty)
+	{
+		s_packed.pack(reinterpret_cast<const float*>(s_positions.data()), s_positions.size(), s_format);
+		s_packed_dirty = false;
+	}
+	return s_packed;
+}
+
+// out and index are dummyOut and dummyOutIndex for UpdateAll, or a chunk's
+// output_sink for UpdateRange
+static void update_range_packed(float t, size_t begin, size_t end, float (&out)[100], int& index)
+{
+	const packed_store<2>& store = packed_positions();
+	float p[2][packed_lanes];
+	for (size_t b = begin / packed_lanes; b * packed_lanes < end; ++b)
+	{
+		const size_t first = b * packed_lanes;
+		const size_t lanes = store.decode(s_format, b, p);
+		const size_t lo = begin > first ? begin - first : 0;
+		const size_t hi = end - first < lanes ? end - first : lanes;
+		// every lane at once, in registers, before the per-entity stores
+		float r[packed_lanes];
+		for (size_t l = 0; l < packed_lanes; ++l)
+		{
+			r[l] = lerp(t, p[0][l], p[1][l]);
+		}
+		for (size_t l = lo; l < hi; ++l)
+		{
+			out[index % ARRAY_SIZE(out)] = r[l];
+			index++;
+		}
+	}
+}
+
+static void update_all_samples_packed(const float* ts, size_t count, float* out)
+{
+	const packed_store<2>& store = packed_positions();
+	float p[2][packed_lanes];
+	for (size_t b = 0; b < store.blocks.size(); ++b)
+	{
+		const size_t lanes = store.decode(s_format, b, p);
+		// samples outer and lanes inner, so each sample is one SIMD evaluation
+		// of the whole block
+		for (size_t i = 0; i < count; ++i)
+		{
+			float r[packed_lanes];
+			for (size_t l = 0; l < packed_lanes; ++l)
+			{
+				r[l] = lerp(ts[i], p[0][l], p[1][l]);
+			}
+			for (size_t l = 0; l < lanes; ++l)
+			{
+				out[l * count + i] = r[l];
+			}
+		}
+		out += lanes * count;
+	}
+}
 
 const long long entity_lerp_fast_impl::type = 2;
 
 entity_lerp_fast_impl::entity_lerp_fast_impl(float s, float d)
 {
+	m_slot = s_positions.size();
 	s_positions.push_back({ s,d });
+	s_owners.push_back(this);
+	s_packed_dirty = true;
 }
 
  entity_lerp_fast_impl::~entity_lerp_fast_impl()
 {
+	const size_t last = s_positions.size() - 1;
+	if (m_slot != last)
+	{
+		s_positions[m_slot] = s_positions[last];
+		s_owners[m_slot] = s_owners[last];
+		s_owners[m_slot]->m_slot = m_slot;
+	}
 	s_positions.pop_back();
+	s_owners.pop_back();
+	s_packed_dirty = true;
 }
 
 int  entity_lerp_fast_impl::GetType() const 
@@ -90,33 +183,159 @@ void  entity_lerp_fast_impl::Update(float t) const
 	assert(0); // don't call. 
 }
 
-void  entity_lerp_fast_impl::UpdateAll(float t)
+void  entity_lerp_fast_impl::UpdateInto(float t, output_sink& sink) const
+{
+	assert(0); // don't call. 
+}
+
+static void update_range(float t, size_t begin, size_t end, float (&out)[100], int& index)
 {
-	for (auto& pos : s_positions)
+	if (s_format != param_format::fp32)
+	{
+		update_range_packed(t, begin, end, out, index);
+		return;
+	}
+	for (size_t i = begin; i < end; ++i)
 	{
+		const Pos& pos = s_positions[i];
 #ifdef PRINT
 		cout << "fast_lerp ";
 		cout << lerp(t, pos.x, pos.y);
 		cout << endl;
 #endif
-		dummyOut[dummyOutIndex % ARRAY_SIZE(dummyOut)] = lerp(t, pos.x, pos.y);
-		dummyOutIndex++;
+		out[index % ARRAY_SIZE(out)] = lerp(t, pos.x, pos.y);
+		index++;
+	}
+}
+
+void  entity_lerp_fast_impl::UpdateAll(float t)
+{
+	update_range(t, 0, s_positions.size(), dummyOut, dummyOutIndex);
+}
+
+void  entity_lerp_fast_impl::UpdateRange(float t, size_t begin, size_t end, output_sink& sink)
+{
+	update_range(t, begin, end, sink.out, sink.index);
+}
+
+void  entity_lerp_fast_impl::UpdateAllSamples(const float* ts, size_t count, float* out)
+{
+	if (s_format != param_format::fp32)
+	{
+		update_all_samples_packed(ts, count, out);
+		return;
+	}
+	// entity outer, samples inner: each Pos is loaded once and stays in registers
+	// while every t is evaluated, instead of streaming the store once per t.
+	// Whole blocks of packed_lanes entities go as one SIMD evaluation per
+	// sample, the same shape as the packed kernels, so the formats differ only
+	// in what they load; the remainder one at a time.
+	const size_t n = s_positions.size();
+	const Pos* positions = s_positions.data();
+	size_t e = 0;
+	for (; e + packed_lanes <= n; e += packed_lanes)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			float r[packed_lanes];
+			for (size_t l = 0; l < packed_lanes; ++l)
+			{
+				r[l] = lerp(ts[i], positions[e + l].x, positions[e + l].y);
+			}
+			for (size_t l = 0; l < packed_lanes; ++l)
+			{
+				out[l * count + i] = r[l];
+			}
+		}
+		out += packed_lanes * count;
+	}
+	for (; e < n; ++e)
+	{
+		const float s = positions[e].x;
+		const float d = positions[e].y;
+		for (size_t i = 0; i < count; ++i)
+		{
+			out[i] = lerp(ts[i], s, d);
+		}
+		out += count;
 	}
 }
 
+size_t entity_lerp_fast_impl::Count()
+{
+	return s_positions.size();
+}
+
 void entity_lerp_fast::UpdateAll(float t)
 {
 	entity_lerp_fast_impl::UpdateAll(t);
 }
 
-entity_lerp_fast* create_entity_lerp_fast(float p1, float p2)
+void entity_lerp_fast::UpdateRange(float t, size_t begin, size_t end, output_sink& sink)
+{
+	entity_lerp_fast_impl::UpdateRange(t, begin, end, sink);
+}
+
+void entity_lerp_fast::UpdateAllSamples(const float* ts, size_t count, float* out)
 {
+	entity_lerp_fast_impl::UpdateAllSamples(ts, count, out);
+}
+
+size_t entity_lerp_fast::Count()
+{
+	return entity_lerp_fast_impl::Count();
+}
+
+void entity_lerp_fast::SetParamFormat(param_format format)
+{
+	s_format = format;
+	s_packed_dirty = true;
+}
+
+void entity_lerp_fast::PackParams()
+{
+	if (s_format != param_format::fp32)
+	{
+		packed_positions();
+	}
+}
+
+param_format entity_lerp_fast::ParamFormat()
+{
+	return s_format;
+}
+
+size_t entity_lerp_fast::ParamBytes()
+{
+	return s_format == param_format::fp32 ? s_positions.size() * sizeof(Pos) : packed_positions().bytes();
+}
+
+entity_lerp_fast* create_entity_lerp_fast(float p1, float p2, entity_arena* arena)
+{
+	if (arena)
+	{
+		return arena->create<entity_lerp_fast_impl>(p1, p2);
+	}
 	return new entity_lerp_fast_impl(p1, p2);
 }
 
 
-entity_lerp_slow* create_entity_lerp_slow(float p1, float p2)
+entity_lerp_slow* create_entity_lerp_slow(float p1, float p2, entity_arena* arena)
 {
+	if (arena)
+	{
+		return arena->create<entity_lerp_slow_impl>(p1, p2);
+	}
 	return new entity_lerp_slow_impl(p1, p2);
 }
 
+entity_lerp_fast* create_entity_lerp_fast(float p1, float p2, poly_collection<entity>& collection)
+{
+	return &collection.emplace<entity_lerp_fast_impl>(p1, p2);
+}
+
+entity_lerp_slow* create_entity_lerp_slow(float p1, float p2, poly_collection<entity>& collection)
+{
+	return &collection.emplace<entity_lerp_slow_impl>(p1, p2);
+}
+
@@ -1,4 +1,10 @@
 #pragma once
+#include "packed.h"
+#include <cstddef>
+
+class entity_arena;
+template <class Base> class poly_collection;
+
 class entity_lerp_slow : public entity
 {
 public:
@@ -18,6 +24,19 @@ public:
 	virtual int GetType() const override = 0;
 	virtual void Update(float t) const override = 0;
 	static void UpdateAll(float t);
+	// Update entities [begin, end) of the store, so a frame can be split into chunks.
+	// Results go to sink rather than dummyOut, so chunks can run on any thread.
+	static void UpdateRange(float t, size_t begin, size_t end, output_sink& sink);
+	// Evaluate every entity at each of the count times in ts in one sweep.
+	// out is an entities-by-samples matrix, one row of count floats per entity.
+	static void UpdateAllSamples(const float* ts, size_t count, float* out);
+	static size_t Count();
+	// Select the parameter storage the UpdateAll kernels read from.
+	static void SetParamFormat(param_format format);
+	// Rebuild a stale packed copy now, so concurrent UpdateRange calls only read.
+	static void PackParams();
+	static param_format ParamFormat();
+	static size_t ParamBytes();
 };
 
 class entity_lerp_fast_impl : public entity_lerp_fast
@@ -29,9 +48,20 @@ public:
 	virtual ~entity_lerp_fast_impl();
 	int GetType() const override;
 	void Update(float t) const override;
+	void UpdateInto(float t, output_sink& sink) const override;
 	static void UpdateAll(float t);
+	static void UpdateRange(float t, size_t begin, size_t end, output_sink& sink);
+	static void UpdateAllSamples(const float* ts, size_t count, float* out);
+	static size_t Count();
+private:
+	size_t m_slot; // row of this entity in the position store
 };
 
 
-entity_lerp_fast* create_entity_lerp_fast(float p1, float p2);
-entity_lerp_slow* create_entity_lerp_slow(float p1, float p2);
+// With an arena the entity lives in that arena's pool for its type and is
+// released through the arena; without one it is a plain heap object.
+entity_lerp_fast* create_entity_lerp_fast(float p1, float p2, entity_arena* arena = nullptr);
+entity_lerp_slow* create_entity_lerp_slow(float p1, float p2, entity_arena* arena = nullptr);
+// Construct the entity by value in the collection's segment for its type.
+entity_lerp_fast* create_entity_lerp_fast(float p1, float p2, poly_collection<entity>& collection);
+entity_lerp_slow* create_entity_lerp_slow(float p1, float p2, poly_collection<entity>& collection);
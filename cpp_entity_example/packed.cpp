@@ -0,0 +1,113 @@
+// packed.cpp : half conversion and error reporting for the packed parameter stores.
+//
+
+#include "stdafx.h"
+#include "packed.h"
+
+#include <cmath>
+#include <cstring>
+
+const char* param_format_name(param_format format)
+{
+	switch (format)
+	{
+	case param_format::fp16: return "fp16";
+	case param_format::fixed16: return "fixed16";
+	default: return "fp32";
+	}
+}
+
+uint16_t float_to_half(float f)
+{
+	uint32_t x;
+	memcpy(&x, &f, sizeof(x));
+	const uint32_t sign = (x >> 16) & 0x8000;
+	const uint32_t mantissa = x & 0x007fffff;
+	const int exponent = static_cast<int>((x >> 23) & 0xff) - 127 + 15;
+
+	if (((x >> 23) & 0xff) == 0xff)
+	{
+		// inf stays inf, nan keeps a quiet mantissa bit
+		return static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+	}
+	if (exponent >= 0x1f)
+	{
+		return static_cast<uint16_t>(sign | 0x7c00);
+	}
+	if (exponent <= 0)
+	{
+		if (exponent < -10)
+		{
+			return static_cast<uint16_t>(sign);
+		}
+		// subnormal half: shift in the implicit bit, round to nearest even
+		const uint32_t m = mantissa | 0x00800000;
+		const int shift = 14 - exponent;
+		uint32_t h = m >> shift;
+		const uint32_t rem = m & ((1u << shift) - 1);
+		const uint32_t half = 1u << (shift - 1);
+		if (rem > half || (rem == half && (h & 1)))
+		{
+			h++;
+		}
+		return static_cast<uint16_t>(sign | h);
+	}
+	uint32_t h = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+	const uint32_t rem = mantissa & 0x1fff;
+	if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+	{
+		h++; // may carry into the exponent, which rounds up to inf correctly
+	}
+	return static_cast<uint16_t>(sign | h);
+}
+
+float half_to_float(uint16_t h)
+{
+	const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+	uint32_t exponent = (h >> 10) & 0x1f;
+	uint32_t mantissa = h & 0x3ff;
+	uint32_t x;
+	if (exponent == 0x1f)
+	{
+		x = sign | 0x7f800000 | (mantissa << 13);
+	}
+	else if (exponent == 0)
+	{
+		if (mantissa == 0)
+		{
+			x = sign;
+		}
+		else
+		{
+			// normalise the subnormal
+			exponent = 127 - 15 + 1;
+			while (!(mantissa & 0x400))
+			{
+				mantissa <<= 1;
+				exponent--;
+			}
+			x = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+		}
+	}
+	else
+	{
+		x = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+	}
+	float f;
+	memcpy(&f, &x, sizeof(f));
+	return f;
+}
+
+param_error compare_outputs(const float* reference, const float* packed, size_t n)
+{
+	param_error e = { 0.0f, 0.0f };
+	double sum = 0.0;
+	for (size_t i = 0; i < n; ++i)
+	{
+		const float d = std::fabs(reference[i] - packed[i]);
+		e.max_abs = d > e.max_abs ? d : e.max_abs;
+		sum += double(d) * d;
+	}
+	e.rms = n ? static_cast<float>(std::sqrt(sum / n)) : 0.0f;
+	return e;
+}
@@ -0,0 +1,181 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__F16C__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Storage formats for the fast-path parameter stores.
+// fp32 is the plain float store; the other two halve the bytes per parameter.
+enum class param_format
+{
+	fp32,
+	fp16,    // IEEE half, decoded with F16C where available
+	fixed16, // 16 bit unsigned fixed point with a per-block scale and offset
+};
+
+const char* param_format_name(param_format format);
+
+uint16_t float_to_half(float f);
+float half_to_float(uint16_t h);
+
+const size_t packed_lanes = 8;
+
+// half_to_float for the decoders: one multiply rescales the exponent, and a
+// select keeps inf and nan, so a loop over lanes vectorises without F16C.
+inline float half_to_float_lane(uint16_t h)
+{
+	const uint32_t magnitude = static_cast<uint32_t>(h & 0x7fff) << 13;
+	float f;
+	memcpy(&f, &magnitude, sizeof(f));
+	f *= 5.192296858534828e+33f; // 2^(127 - 15)
+	uint32_t x;
+	memcpy(&x, &f, sizeof(x));
+	// all ones for inf and nan, which keep their payload with the top exponent
+	const uint32_t special = 0u - static_cast<uint32_t>((h & 0x7c00) == 0x7c00);
+	x = (x & ~special) | ((0x7f800000 | magnitude) & special);
+	x |= static_cast<uint32_t>(h & 0x8000) << 16;
+	memcpy(&f, &x, sizeof(f));
+	return f;
+}
+
+// Decode one packed lane group (packed_lanes values) of a single parameter.
+// scale and offset are only used by fixed16. Inline so the kernels keep the
+// decoded lanes in registers.
+inline void decode_lanes(param_format format, const uint16_t* in, float scale, float offset, float* out)
+{
+	static_assert(packed_lanes == 8, "decode_lanes assumes 8 lanes per block");
+	if (format == param_format::fp16)
+	{
+#ifdef __F16C__
+		_mm256_storeu_ps(out, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in))));
+#else
+		for (size_t l = 0; l < packed_lanes; ++l)
+		{
+			out[l] = half_to_float_lane(in[l]);
+		}
+#endif
+	}
+	else
+	{
+#ifdef __AVX2__
+		__m256 q = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in))));
+		_mm256_storeu_ps(out, _mm256_add_ps(_mm256_mul_ps(q, _mm256_set1_ps(scale)), _mm256_set1_ps(offset)));
+#else
+		for (size_t l = 0; l < packed_lanes; ++l)
+		{
+			out[l] = in[l] * scale + offset;
+		}
+#endif
+	}
+}
+// fixed16 shares one scale and offset per parameter across this many entities,
+// so the quantisation range stays local without eating the bandwidth saved.
+const size_t packed_scale_block = 64;
+
+// A store of Fields floats per entity, packed into blocks of packed_lanes
+// entities. Each block is SoA so a parameter of all its entities decodes with
+// one SIMD conversion.
+template <size_t Fields>
+struct packed_store
+{
+	struct block
+	{
+		uint16_t v[Fields][packed_lanes];
+	};
+
+	std::vector<block> blocks;
+	std::vector<float> scale;  // fixed16 only, Fields per scale block
+	std::vector<float> offset;
+	size_t count = 0;
+
+	// src holds n entities of Fields consecutive floats.
+	void pack(const float* src, size_t n, param_format format)
+	{
+		count = n;
+		blocks.assign((n + packed_lanes - 1) / packed_lanes, block());
+		scale.clear();
+		offset.clear();
+		if (format == param_format::fixed16)
+		{
+			const size_t ranges = (n + packed_scale_block - 1) / packed_scale_block;
+			scale.resize(ranges * Fields);
+			offset.resize(ranges * Fields);
+			for (size_t r = 0; r < ranges; ++r)
+			{
+				const size_t first = r * packed_scale_block;
+				const size_t last = n - first < packed_scale_block ? n : first + packed_scale_block;
+				for (size_t f = 0; f < Fields; ++f)
+				{
+					float lo = src[first * Fields + f];
+					float hi = lo;
+					for (size_t i = first + 1; i < last; ++i)
+					{
+						float v = src[i * Fields + f];
+						lo = v < lo ? v : lo;
+						hi = v > hi ? v : hi;
+					}
+					offset[r * Fields + f] = lo;
+					scale[r * Fields + f] = hi > lo ? (hi - lo) / 65535.0f : 0.0f;
+				}
+			}
+		}
+		for (size_t i = 0; i < n; ++i)
+		{
+			block& dst = blocks[i / packed_lanes];
+			for (size_t f = 0; f < Fields; ++f)
+			{
+				const float v = src[i * Fields + f];
+				if (format == param_format::fp16)
+				{
+					dst.v[f][i % packed_lanes] = float_to_half(v);
+				}
+				else
+				{
+					const size_t k = (i / packed_scale_block) * Fields + f;
+					float q = scale[k] > 0.0f ? (v - offset[k]) / scale[k] + 0.5f : 0.0f;
+					dst.v[f][i % packed_lanes] = static_cast<uint16_t>(q > 65535.0f ? 65535.0f : q);
+				}
+			}
+		}
+	}
+
+	// Decode block b into out[Fields][packed_lanes], returning its live lane count.
+	// Padding lanes of the last block are zero and are never written out.
+	size_t decode(param_format format, size_t b, float (*out)[packed_lanes]) const
+	{
+		static_assert(packed_scale_block % packed_lanes == 0, "a block never straddles two scale ranges");
+		const block& src = blocks[b];
+		const size_t k = (b * packed_lanes / packed_scale_block) * Fields;
+		for (size_t f = 0; f < Fields; ++f)
+		{
+			if (format == param_format::fixed16)
+			{
+				decode_lanes(format, src.v[f], scale[k + f], offset[k + f], out[f]);
+			}
+			else
+			{
+				decode_lanes(format, src.v[f], 0.0f, 0.0f, out[f]);
+			}
+		}
+		const size_t first = b * packed_lanes;
+		return count - first < packed_lanes ? count - first : packed_lanes;
+	}
+
+	size_t bytes() const
+	{
+		return blocks.size() * sizeof(block) + (scale.size() + offset.size()) * sizeof(float);
+	}
+};
+
+// Error of a packed evaluation against the float path over the same samples.
+struct param_error
+{
+	float max_abs;
+	float rms;
+};
+
+param_error compare_outputs(const float* reference, const float* packed, size_t n);
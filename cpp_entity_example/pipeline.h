@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Hands whole frames of output from the simulation thread to consumer
+// threads (rendering, replication) through a ring of buffers, without locks.
+//
+// Frames are numbered from 1 and frame n lives in buffer (n - 1) % buffers.
+// With two buffers the simulation writes frame N+1 while consumers read
+// frame N; with three it can get a further frame ahead. The writer only
+// reuses a buffer once every consumer has finished with the frame in it, and
+// a consumer only reads a frame once it is published, so neither side ever
+// sees a half-written frame. Waiting is a yield loop, never a mutex.
+template <class Frame>
+class frame_pipeline
+{
+public:
+	frame_pipeline(size_t buffers, size_t consumers)
+		: m_frames(buffers)
+		, m_published(0)
+		, m_consumers(consumers)
+		, m_consumed(new counter[consumers])
+	{
+		for (size_t c = 0; c < consumers; ++c)
+		{
+			m_consumed[c].frame.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	size_t buffers() const { return m_frames.size(); }
+
+	// Simulation thread: wait for the buffer frame n goes in to be free and return it.
+	Frame& begin_write(uint64_t n)
+	{
+		const uint64_t buffers = m_frames.size();
+		if (n > buffers)
+		{
+			for (size_t c = 0; c < m_consumers; ++c)
+			{
+				while (m_consumed[c].frame.load(std::memory_order_acquire) < n - buffers)
+				{
+					std::this_thread::yield();
+				}
+			}
+		}
+		return m_frames[(n - 1) % buffers];
+	}
+
+	// Simulation thread: make frame n visible to the consumers.
+	void end_write(uint64_t n)
+	{
+		m_published.store(n, std::memory_order_release);
+	}
+
+	// Consumer thread c: wait for frame n to be published and return it.
+	const Frame& begin_read(size_t c, uint64_t n)
+	{
+		(void)c;
+		while (m_published.load(std::memory_order_acquire) < n)
+		{
+			std::this_thread::yield();
+		}
+		return m_frames[(n - 1) % m_frames.size()];
+	}
+
+	// Consumer thread c: done with frame n, its buffer may be reused.
+	void end_read(size_t c, uint64_t n)
+	{
+		m_consumed[c].frame.store(n, std::memory_order_release);
+	}
+
+private:
+	struct counter
+	{
+		std::atomic<uint64_t> frame;
+		char pad[64 - sizeof(std::atomic<uint64_t>)]; // one consumer per cache line
+	};
+
+	std::vector<Frame> m_frames;
+	std::atomic<uint64_t> m_published;
+	size_t m_consumers;
+	std::unique_ptr<counter[]> m_consumed;
+};
@@ -0,0 +1,183 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// A polymorphic collection in the spirit of boost::poly_collection.
+// Each concrete type derived from Base is stored by value in its own segment,
+// so there is no heap object or pointer chase per element, and iterating a
+// segment makes the same virtual call on every element back to back.
+//
+// Range-for yields Base* (by const reference), so loops written against
+// vector<unique_ptr<Base>> such as
+//     for (auto &a : entity_vec) { a->Update(t); }
+// compile unchanged. Elements never move once constructed.
+template <class Base>
+class poly_collection
+{
+	struct segment
+	{
+		size_t type;
+		size_t stride;
+		ptrdiff_t base_offset; // from the start of an element to its Base subobject
+		size_t count;
+		std::vector<std::unique_ptr<char[]>> blocks;
+		void (*destroy)(void*);
+
+		char* element(size_t i) const
+		{
+			return blocks[i / block_elements].get() + (i % block_elements) * stride;
+		}
+		Base* base(size_t i) const
+		{
+			return reinterpret_cast<Base*>(element(i) + base_offset);
+		}
+	};
+
+public:
+	static const size_t block_elements = 256;
+
+	poly_collection() {}
+	~poly_collection() { clear(); }
+	poly_collection(const poly_collection&) = delete;
+	poly_collection& operator=(const poly_collection&) = delete;
+
+	template <class T, class... Args>
+	T& emplace(Args&&... args)
+	{
+		segment& s = segment_for<T>();
+		if (s.count == s.blocks.size() * block_elements)
+		{
+			s.blocks.emplace_back(new char[s.stride * block_elements]);
+		}
+		T* object = new (s.element(s.count)) T(std::forward<Args>(args)...);
+		if (s.count == 0)
+		{
+			// a complete T always has its Base at the same offset
+			s.base_offset = reinterpret_cast<char*>(static_cast<Base*>(object)) - reinterpret_cast<char*>(object);
+		}
+		s.count++;
+		m_size++;
+		return *object;
+	}
+
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+	size_t segments() const { return m_segments.size(); }
+
+	// Destroy every element, segment by segment.
+	void clear()
+	{
+		for (auto& s : m_segments)
+		{
+			for (size_t i = 0; i < s->count; ++i)
+			{
+				s->destroy(s->element(i));
+			}
+			s->count = 0;
+		}
+		m_size = 0;
+	}
+
+	// Call f(Base&) on every element, one segment at a time. Tighter than the
+	// iterators since it walks each block with a fixed stride.
+	template <class F>
+	void for_each(F f) const
+	{
+		for (auto& s : m_segments)
+		{
+			size_t left = s->count;
+			for (auto& block : s->blocks)
+			{
+				const size_t n = left < block_elements ? left : block_elements;
+				char* p = block.get() + s->base_offset;
+				for (size_t i = 0; i < n; ++i, p += s->stride)
+				{
+					f(*reinterpret_cast<Base*>(p));
+				}
+				left -= n;
+			}
+		}
+	}
+
+	class iterator
+	{
+	public:
+		Base* const& operator*() const { return m_current; }
+		Base* operator->() const { return m_current; }
+		iterator& operator++()
+		{
+			++m_index;
+			settle();
+			return *this;
+		}
+		bool operator==(const iterator& other) const { return m_segment == other.m_segment && m_index == other.m_index; }
+		bool operator!=(const iterator& other) const { return !(*this == other); }
+
+	private:
+		friend class poly_collection;
+		iterator(const poly_collection* owner, size_t segment)
+			: m_owner(owner)
+			, m_segment(segment)
+			, m_index(0)
+			, m_current(nullptr)
+		{
+			settle();
+		}
+		void settle()
+		{
+			const auto& segments = m_owner->m_segments;
+			while (m_segment < segments.size() && m_index == segments[m_segment]->count)
+			{
+				++m_segment;
+				m_index = 0;
+			}
+			m_current = m_segment < segments.size() ? segments[m_segment]->base(m_index) : nullptr;
+		}
+
+		const poly_collection* m_owner;
+		size_t m_segment;
+		size_t m_index;
+		Base* m_current;
+	};
+
+	iterator begin() const { return iterator(this, 0); }
+	iterator end() const { return iterator(this, m_segments.size()); }
+
+private:
+	template <class T>
+	static size_t type_index()
+	{
+		static const char tag = 0;
+		return reinterpret_cast<size_t>(&tag);
+	}
+
+	template <class T>
+	segment& segment_for()
+	{
+		const size_t type = type_index<T>();
+		for (auto& s : m_segments)
+		{
+			if (s->type == type)
+			{
+				return *s;
+			}
+		}
+		segment* s = new segment();
+		s->type = type;
+		s->stride = (sizeof(T) + alignof(T) - 1) / alignof(T) * alignof(T);
+		s->base_offset = 0;
+		s->count = 0;
+		s->destroy = [](void* object) { static_cast<T*>(object)->~T(); };
+		m_segments.emplace_back(s);
+		return *s;
+	}
+
+	std::vector<std::unique_ptr<segment>> m_segments;
+	size_t m_size = 0;
+};
+
+template <class Base>
+const size_t poly_collection<Base>::block_elements;
@@ -0,0 +1,127 @@
+// registry.cpp : lock-free spawn/despawn queue in front of the entity container.
+//
+
+#include "stdafx.h"
+#include "registry.h"
+#include "lerp.h"
+#include "hermite.h"
+
+entity_registry::entity_registry()
+	: m_inbox(nullptr)
+	, m_next_id(1)
+{
+}
+
+entity_registry::~entity_registry()
+{
+	command* c = m_inbox.exchange(nullptr, std::memory_order_acquire);
+	while (c)
+	{
+		command* next = c->next;
+		delete c;
+		c = next;
+	}
+}
+
+entity_id entity_registry::spawn(long long type, float p1, float p2, float n1, float n2)
+{
+	command* c = new command;
+	c->id = m_next_id.fetch_add(1, std::memory_order_relaxed);
+	c->type = type;
+	c->params[0] = p1;
+	c->params[1] = p2;
+	c->params[2] = n1;
+	c->params[3] = n2;
+	// read the id before posting, the update thread may free c straight after
+	const entity_id id = c->id;
+	post(c);
+	return id;
+}
+
+void entity_registry::despawn(entity_id id)
+{
+	command* c = new command;
+	c->id = id;
+	c->type = 0;
+	post(c);
+}
+
+void entity_registry::post(command* c)
+{
+	// Treiber push. The consumer takes the whole list at once, so there is no
+	// pop race and no ABA to worry about.
+	command* head = m_inbox.load(std::memory_order_relaxed);
+	do
+	{
+		c->next = head;
+	} while (!m_inbox.compare_exchange_weak(head, c, std::memory_order_release, std::memory_order_relaxed));
+}
+
+size_t entity_registry::apply()
+{
+	command* c = m_inbox.exchange(nullptr, std::memory_order_acquire);
+
+	// the list is newest first; reverse it so requests apply in posting order
+	command* ordered = nullptr;
+	while (c)
+	{
+		command* next = c->next;
+		c->next = ordered;
+		ordered = c;
+		c = next;
+	}
+
+	size_t applied = 0;
+	while (ordered)
+	{
+		command* next = ordered->next;
+		const float* p = ordered->params;
+		entity* e = nullptr;
+		if (ordered->type == entity_lerp_fast::type)
+		{
+			e = create_entity_lerp_fast(p[0], p[1]);
+		}
+		else if (ordered->type == entity_lerp_slow::type)
+		{
+			e = create_entity_lerp_slow(p[0], p[1]);
+		}
+		else if (ordered->type == entity_hermite_fast::type)
+		{
+			e = create_entity_hermite_fast(p[0], p[1], p[2], p[3]);
+		}
+		else if (ordered->type == entity_hermite::type)
+		{
+			e = create_entity_hermite(p[0], p[1], p[2], p[3]);
+		}
+
+		if (e)
+		{
+			m_index[ordered->id] = m_entities.size();
+			m_entities.emplace_back(e);
+			m_ids.push_back(ordered->id);
+			applied++;
+		}
+		else if (ordered->type == 0)
+		{
+			auto found = m_index.find(ordered->id);
+			if (found != m_index.end())
+			{
+				// swap the last entity into the hole to keep the container dense
+				const size_t slot = found->second;
+				m_index.erase(found);
+				if (slot + 1 != m_entities.size())
+				{
+					m_entities[slot] = std::move(m_entities.back());
+					m_ids[slot] = m_ids.back();
+					m_index[m_ids[slot]] = slot;
+				}
+				m_entities.pop_back();
+				m_ids.pop_back();
+				applied++;
+			}
+		}
+		delete ordered;
+		ordered = next;
+	}
+	return applied;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "entity.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+typedef uint64_t entity_id;
+
+// Owns the live entities and takes spawn/despawn requests from any thread.
+// Requests go onto a lock-free list that only the update thread drains, at a
+// frame boundary, so producers never wait on the update loop and the update
+// loop never takes a lock.
+class entity_registry
+{
+public:
+	entity_registry();
+	~entity_registry();
+
+	// Any thread. Queue creation of an entity of the given type key
+	// (entity_lerp_fast::type and friends); unused params are ignored.
+	entity_id spawn(long long type, float p1, float p2, float n1 = 0.0f, float n2 = 0.0f);
+	// Any thread. Queue removal of a spawned entity; unknown ids are ignored.
+	void despawn(entity_id id);
+
+	// Update thread only, between frames. Apply every queued request in the
+	// order it was posted and return how many were applied.
+	size_t apply();
+
+	// The entities live as of the last apply(). Only valid on the update thread.
+	const std::vector<std::unique_ptr<entity>>& entities() const { return m_entities; }
+
+private:
+	struct command
+	{
+		entity_id id;
+		long long type; // 0 for a despawn
+		float params[4];
+		command* next;
+	};
+
+	void post(command* c);
+
+	std::atomic<command*> m_inbox;
+	std::atomic<entity_id> m_next_id;
+
+	// update thread only
+	std::vector<std::unique_ptr<entity>> m_entities;
+	std::vector<entity_id> m_ids; // parallel to m_entities
+	std::unordered_map<entity_id, size_t> m_index;
+};
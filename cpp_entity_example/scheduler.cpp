@@ -0,0 +1,121 @@
+// scheduler.cpp : work-stealing pool used by the parallel update example.
+//
+
+#include "stdafx.h"
+#include "scheduler.h"
+
+work_stealing_pool::work_stealing_pool(unsigned workers)
+	: m_pending(0)
+	, m_stop(false)
+{
+	if (workers == 0)
+	{
+		workers = 1;
+	}
+	for (unsigned i = 0; i < workers; ++i)
+	{
+		m_queues.emplace_back(new queue);
+	}
+	// worker 0 is whoever calls wait()
+	for (unsigned i = 1; i < workers; ++i)
+	{
+		m_threads.emplace_back(&work_stealing_pool::worker_main, this, i);
+	}
+}
+
+work_stealing_pool::~work_stealing_pool()
+{
+	{
+		std::lock_guard<std::mutex> guard(m_wake_lock);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (auto& thread : m_threads)
+	{
+		thread.join();
+	}
+}
+
+void work_stealing_pool::push(unsigned worker, task t)
+{
+	m_pending.fetch_add(1, std::memory_order_relaxed);
+	{
+		queue& q = *m_queues[worker % m_queues.size()];
+		std::lock_guard<std::mutex> guard(q.lock);
+		q.tasks.push_back(std::move(t));
+	}
+	{
+		// taking the wake lock orders this against a worker checking m_pending
+		std::lock_guard<std::mutex> guard(m_wake_lock);
+	}
+	m_wake.notify_all();
+}
+
+void work_stealing_pool::wait()
+{
+	while (m_pending.load(std::memory_order_acquire) != 0)
+	{
+		if (!try_run(0))
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+bool work_stealing_pool::try_run(unsigned self)
+{
+	task t;
+	const size_t n = m_queues.size();
+	{
+		// own work newest first, it is the most likely to still be in cache
+		queue& q = *m_queues[self];
+		std::lock_guard<std::mutex> guard(q.lock);
+		if (!q.tasks.empty())
+		{
+			t = std::move(q.tasks.back());
+			q.tasks.pop_back();
+		}
+	}
+	for (size_t i = 1; !t && i < n; ++i)
+	{
+		// steal the oldest, largest-remaining work from the next worker along
+		queue& q = *m_queues[(self + i) % n];
+		std::lock_guard<std::mutex> guard(q.lock);
+		if (!q.tasks.empty())
+		{
+			t = std::move(q.tasks.front());
+			q.tasks.pop_front();
+		}
+	}
+	if (!t)
+	{
+		return false;
+	}
+	t();
+	m_pending.fetch_sub(1, std::memory_order_release);
+	return true;
+}
+
+void work_stealing_pool::worker_main(unsigned self)
+{
+	for (;;)
+	{
+		if (try_run(self))
+		{
+			continue;
+		}
+		std::unique_lock<std::mutex> guard(m_wake_lock);
+		if (m_stop)
+		{
+			return;
+		}
+		if (m_pending.load(std::memory_order_acquire) != 0)
+		{
+			// work is in flight elsewhere; look again shortly for anything left to steal
+			guard.unlock();
+			std::this_thread::yield();
+			continue;
+		}
+		m_wake.wait(guard);
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+// A small work-stealing thread pool for running a frame's update buckets.
+// Each worker owns a deque: it pops its own work from the back and idle
+// workers steal from the front of someone else's, so a long bucket split into
+// chunks spreads over every core instead of pinning one.
+class work_stealing_pool
+{
+public:
+	typedef std::function<void()> task;
+
+	// workers includes the calling thread, which joins in during wait().
+	explicit work_stealing_pool(unsigned workers);
+	~work_stealing_pool();
+
+	unsigned workers() const { return static_cast<unsigned>(m_queues.size()); }
+
+	// Queue a task on a worker's deque. Only the thread that calls wait() pushes.
+	void push(unsigned worker, task t);
+
+	// Run tasks on the calling thread too, until every pushed task has finished.
+	void wait();
+
+private:
+	struct queue
+	{
+		std::mutex lock;
+		std::deque<task> tasks;
+	};
+
+	bool try_run(unsigned self);
+	void worker_main(unsigned self);
+
+	std::vector<std::unique_ptr<queue>> m_queues;
+	std::vector<std::thread> m_threads;
+	std::atomic<size_t> m_pending;
+	bool m_stop;
+	std::mutex m_wake_lock;
+	std::condition_variable m_wake;
+};
@@ -0,0 +1,54 @@
+// world.cpp : shared world descriptions for the update strategies.
+//
+
+#include "stdafx.h"
+#include "world.h"
+#include "lerp.h"
+#include "hermite.h"
+
+#include <algorithm>
+#include <assert.h>
+
+using namespace std;
+
+vector<entity_desc> describe_world(size_t lerp_count, long long lerp_type, size_t hermite_count, long long hermite_type, default_random_engine& generator)
+{
+	uniform_real_distribution<float> distribution(0, 1);
+	vector<entity_desc> world;
+	world.reserve(lerp_count + hermite_count);
+	for (size_t i = 0; i < lerp_count + hermite_count; i++)
+	{
+		entity_desc desc = { i < lerp_count ? lerp_type : hermite_type, { 0.0f, 0.0f, 0.0f, 0.0f } };
+		world.push_back(desc);
+	}
+	shuffle(world.begin(), world.end(), generator);
+	// parameters are drawn after the shuffle, in creation order
+	for (auto& desc : world)
+	{
+		const bool is_lerp = desc.type == entity_lerp_slow::type || desc.type == entity_lerp_fast::type;
+		for (size_t p = 0; p < (is_lerp ? 2u : 4u); p++)
+		{
+			desc.params[p] = distribution(generator);
+		}
+	}
+	return world;
+}
+
+entity* create_entity(const entity_desc& desc, entity_arena* arena)
+{
+	const float* p = desc.params;
+	if (desc.type == entity_lerp_slow::type)
+	{
+		return create_entity_lerp_slow(p[0], p[1], arena);
+	}
+	if (desc.type == entity_lerp_fast::type)
+	{
+		return create_entity_lerp_fast(p[0], p[1], arena);
+	}
+	if (desc.type == entity_hermite::type)
+	{
+		return create_entity_hermite(p[0], p[1], p[2], p[3], arena);
+	}
+	assert(desc.type == entity_hermite_fast::type);
+	return create_entity_hermite_fast(p[0], p[1], p[2], p[3], arena);
+}
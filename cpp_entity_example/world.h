@@ -0,0 +1,23 @@
+#pragma once
+#include "entity.h"
+
+#include <cstddef>
+#include <random>
+#include <vector>
+
+class entity_arena;
+
+// One entity of a world description: its type id and up to four parameters
+// (lerp uses the first two, hermite all four). Every backend builds the same
+// world from the same description, so their numbers stay comparable.
+struct entity_desc
+{
+	long long type;
+	float params[4];
+};
+
+// lerp_count entities of lerp_type and hermite_count of hermite_type, shuffled.
+std::vector<entity_desc> describe_world(size_t lerp_count, long long lerp_type, size_t hermite_count, long long hermite_type, std::default_random_engine& generator);
+
+// Build the virtual-hierarchy entity for a description with the matching factory.
+entity* create_entity(const entity_desc& desc, entity_arena* arena = nullptr);
@@ -0,0 +1,349 @@
+// g++ bench.cpp -O2 -g -std=c++11 -Wno-pmf-conversions -Wall -o bench -ldl && ./bench
+// Times the gfp.hpp primitives against what they replace, on the pmf.cpp
+// hierarchies. Every technique answers the same question, "is this object a
+// D?", for a shuffled mix of D and non-D objects.
+//
+// throughput: independent tests over the array, so they overlap
+// latency:    each result picks the next object, so they cannot; a test
+//             that compiles to a branch (typeid's name check) still lets
+//             the CPU guess and run ahead
+// hot:        256 objects, in L1 after the first pass
+// cold:       2^19 objects, each flushed from every cache level with clflush
+//             before each timed pass, so every test misses to memory however
+//             large the last-level cache is. Only the objects are cold:
+//             vtables, type_info and the stop:: caches are shared by every
+//             object and stay hot. Needs SSE2; skipped without it.
+#include "fast_cast.hpp"
+#include "gfp.hpp"
+#include "vtable.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// The hierarchies of pmf.cpp, made polymorphic at the root so dynamic_cast
+// applies from every level. Each class also records its type in the root's
+// m_typedata, the way cpp_entity_example's entities do.
+namespace single {
+class B {
+public:
+  static const long long type;
+  B() : m_typedata(&type) {}
+  virtual int f() { return 0; }
+  virtual ~B() {}
+  const long long *m_typedata;
+};
+class D : public B {
+public:
+  static const long long type;
+  D() { m_typedata = &type; }
+  int f() override { return 1; }
+};
+class E : public B {
+public:
+  static const long long type;
+  E() { m_typedata = &type; }
+  int f() override { return 2; }
+};
+const long long B::type = 0;
+const long long D::type = 1;
+const long long E::type = 2;
+};
+
+namespace diamond {
+class B {
+public:
+  static const long long type;
+  B() : m_typedata(&type) {}
+  virtual int f() { return 0; }
+  virtual ~B() {}
+  const long long *m_typedata;
+};
+class M1 : public B {
+public:
+  static const long long type;
+  M1() { m_typedata = &type; }
+  int f() override { return 1; }
+};
+class M2 : public B {
+public:
+  static const long long type;
+  M2() { m_typedata = &type; }
+  int f() override { return 2; }
+};
+class D : public M1, public M2 {
+public:
+  static const long long type;
+  D() { M1::m_typedata = M2::m_typedata = &type; }
+  int f() override { return 3; }
+};
+const long long B::type = 0;
+const long long M1::type = 1;
+const long long M2::type = 2;
+const long long D::type = 3;
+};
+
+namespace virtual_base {
+class B {
+public:
+  static const long long type;
+  B() : m_typedata(&type) {}
+  virtual int f() { return 0; }
+  virtual ~B() {}
+  const long long *m_typedata;
+};
+class M1 : public virtual B {
+public:
+  static const long long type;
+  M1() { m_typedata = &type; }
+  int f() override { return 1; }
+};
+class M2 : public virtual B {
+public:
+  static const long long type;
+  M2() { m_typedata = &type; }
+  int f() override { return 2; }
+};
+class D : public M1, public M2 {
+public:
+  static const long long type;
+  D() { m_typedata = &type; }
+  int f() override { return 3; }
+};
+const long long B::type = 0;
+const long long M1::type = 1;
+const long long M2::type = 2;
+const long long D::type = 3;
+};
+
+const size_t cache_line = 64;
+
+// A shuffled mix of Hit and Miss objects, seen through From pointers: a
+// type test on them succeeds half the time. n must be a power of two.
+template <class From> struct population {
+  std::vector<std::unique_ptr<From>> owned;
+  std::vector<From *> objects;
+  From *hit; // an object of the type tested for
+  // every cache line of every object, to flush; empty when hot
+  std::vector<const char *> lines;
+
+  template <class Hit, class Miss>
+  static auto make(size_t n, bool cold) -> population {
+    population p;
+    for (size_t i = 0; i < n; ++i) {
+      if (i % 2) {
+        p.add(new Hit(), sizeof(Hit), cold);
+      } else {
+        p.add(new Miss(), sizeof(Miss), cold);
+      }
+    }
+    p.hit = p.owned[1].get();
+    std::shuffle(p.owned.begin(), p.owned.end(), std::mt19937(1));
+    for (auto &o : p.owned) {
+      p.objects.push_back(o.get());
+    }
+    return p;
+  }
+
+  // Push the objects out of every cache level, so the next pass reads each
+  // from memory.
+  void evict() const {
+#if defined(__SSE2__)
+    for (auto *line : lines) {
+      _mm_clflush(line);
+    }
+    _mm_mfence();
+#endif
+  }
+
+private:
+  void add(From *object, size_t size, bool cold) {
+    owned.emplace_back(object);
+    if (cold) {
+      // the complete object, which a From subobject need not start
+      auto *begin = static_cast<const char *>(dynamic_cast<void *>(object));
+      auto first = reinterpret_cast<uintptr_t>(begin) & ~(cache_line - 1);
+      for (auto line = first; line < reinterpret_cast<uintptr_t>(begin) + size;
+           line += cache_line) {
+        lines.push_back(reinterpret_cast<const char *>(line));
+      }
+    }
+  }
+};
+
+// Keeps results alive without a store the loop would wait on
+volatile size_t sink;
+
+using bench_clock = std::chrono::steady_clock;
+const auto bench_time = std::chrono::milliseconds(20);
+
+auto ns_per_test(bench_clock::duration elapsed, size_t tests) -> double {
+  return std::chrono::duration<double, std::nano>(elapsed).count() /
+         static_cast<double>(tests);
+}
+
+// Nanoseconds per test over passes of p's objects, after a warm-up pass,
+// until at least bench_time has been timed. Hot passes run back to back
+// under one clock; a cold population is evicted, untimed, before each pass.
+template <class From, class Pass>
+auto time_passes(const population<From> &p, Pass pass) -> double {
+  size_t hits = pass();
+  size_t passes = 0;
+  auto elapsed = bench_clock::duration::zero();
+  if (p.lines.empty()) {
+    auto start = bench_clock::now();
+    do {
+      hits += pass();
+      ++passes;
+      elapsed = bench_clock::now() - start;
+    } while (elapsed < bench_time);
+  } else {
+    do {
+      p.evict();
+      auto start = bench_clock::now();
+      hits += pass();
+      elapsed += bench_clock::now() - start;
+      ++passes;
+    } while (elapsed < bench_time);
+  }
+  sink = hits;
+  return ns_per_test(elapsed, passes * p.objects.size());
+}
+
+// Nanoseconds per test of independent objects
+template <class From, class Op>
+auto throughput(const population<From> &p, Op op) -> double {
+  return time_passes(p, [&p, op]() {
+    size_t hits = 0;
+    for (auto *o : p.objects) {
+      hits += op(o) ? 1 : 0;
+    }
+    return hits;
+  });
+}
+
+// Nanoseconds per test when each test waits for the one before: whether it
+// hit decides which object is next.
+template <class From, class Op>
+auto latency(const population<From> &p, Op op) -> double {
+  const size_t mask = p.objects.size() - 1;
+  size_t i = 0;
+  return time_passes(p, [&p, op, mask, &i]() {
+    size_t hits = 0;
+    for (size_t k = 0; k < p.objects.size(); ++k) {
+      auto hit = op(p.objects[i]) ? 1 : 0;
+      hits += hit;
+      i = (i + 1 + hit) & mask;
+    }
+    return hits;
+  });
+}
+
+template <class From, class Op>
+void measure(const char *hierarchy, const char *cache,
+             const population<From> &p, const char *technique, Op op) {
+  std::printf("%-13s %-5s %-26s %9.2f %9.2f\n", hierarchy, cache, technique,
+              throughput(p, op), latency(p, op));
+}
+
+// Dense ids for dynamic types, handed out in order of first sight and cached
+// per vptr.
+class dense_type_ids {
+public:
+  auto id(const void *object) -> uint32_t {
+    return cache_.get(stop::get_vptr(object), [this, object]() {
+      auto type = std::type_index(stop::GetTypeInfo(object));
+      auto found = ids_.find(type);
+      if (found == ids_.end()) {
+        found = ids_.emplace(type, static_cast<uint32_t>(ids_.size())).first;
+      }
+      return found->second;
+    });
+  }
+
+private:
+  stop::vptr_cache<uint32_t> cache_;
+  std::unordered_map<std::type_index, uint32_t> ids_;
+};
+
+// Every way of asking whether an object of static type From is a Hit.
+template <class From, class Hit>
+void bench_type_tests(const char *hierarchy, const char *cache,
+                      const population<From> &p) {
+  using memfun = int (From::*)();
+  memfun mf = &From::f;
+
+  auto target = stop::GetFunctionPointer(p.hit, mf);
+  measure(hierarchy, cache, p, "stop::GetFunctionPointer",
+          [mf, target](From *o) {
+            return stop::GetFunctionPointer(o, mf) == target;
+          });
+
+  stop::slot_probe<memfun> probe(mf, p.hit);
+  measure(hierarchy, cache, p, "stop::slot_probe",
+          [&probe](From *o) { return probe.matches(o); });
+
+#if defined(__GNUC__) && !defined(__clang__)
+  using funcptr = int (*)(From *);
+  measure(hierarchy, cache, p, "GCC bound member cast",
+          [mf, target](From *o) { return (funcptr)(o->*mf) == target; });
+#endif
+
+  measure(hierarchy, cache, p, "typeid",
+          [](From *o) { return typeid(*o) == typeid(Hit); });
+
+  measure(hierarchy, cache, p, "stop::GetTypeInfo",
+          [](From *o) { return stop::GetTypeInfo(o) == typeid(Hit); });
+
+  measure(hierarchy, cache, p, "dynamic_cast",
+          [](From *o) { return dynamic_cast<Hit *>(o) != nullptr; });
+
+  measure(hierarchy, cache, p, "stop::fast_cast",
+          [](From *o) { return stop::fast_cast<Hit *>(o) != nullptr; });
+
+  measure(hierarchy, cache, p, "m_typedata",
+          [](From *o) { return o->m_typedata == &Hit::type; });
+
+  dense_type_ids ids;
+  auto hit_id = ids.id(p.hit);
+  measure(hierarchy, cache, p, "cached dense type id",
+          [&ids, hit_id](From *o) { return ids.id(o) == hit_id; });
+}
+
+template <class From, class Hit, class Miss>
+void bench_hierarchy(const char *hierarchy) {
+  {
+    auto p = population<From>::template make<Hit, Miss>(256, false);
+    bench_type_tests<From, Hit>(hierarchy, "hot", p);
+  }
+#if defined(__SSE2__)
+  {
+    auto p = population<From>::template make<Hit, Miss>(size_t(1) << 19, true);
+    bench_type_tests<From, Hit>(hierarchy, "cold", p);
+  }
+#endif
+}
+};
+
+int main() {
+  std::printf("%-13s %-5s %-26s %9s %9s\n", "hierarchy", "cache", "technique",
+              "ns/test", "latency");
+  bench_hierarchy<single::B, single::D, single::E>("single");
+  // B is ambiguous in D, so start from one side of the diamond
+  bench_hierarchy<diamond::M1, diamond::D, diamond::M1>("diamond");
+  bench_hierarchy<virtual_base::B, virtual_base::D, virtual_base::M1>(
+      "virtual base");
+  return 0;
+}
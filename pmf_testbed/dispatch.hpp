@@ -0,0 +1,109 @@
+#pragma once
+
+// The harness hiergen's generated hierarchies are compiled against. For each
+// class C and each unambiguous base X of C, check<C, X> takes X::f through an
+// X* to a C, makes sure stop:: finds the same function as the GCC extension
+// and that calling it reaches C::f, and times the ways of calling it.
+
+#include "gfp.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+// for the generated classes, see hiergen.cpp
+#define NOINLINE __attribute__((noinline))
+
+namespace dispatch {
+
+const int calls = 1 << 14;
+
+// Keeps results alive without a store the loop would wait on
+volatile int sink;
+
+// Hides p's value from the optimiser, so a call through it stays indirect.
+template <class T> auto hide(T p) -> T {
+  asm volatile("" : "+r"(p));
+  return p;
+}
+
+// Nanoseconds per call
+template <class Call> auto time_calls(Call call) -> double {
+  using clock = std::chrono::steady_clock;
+  int sum = 0;
+  auto start = clock::now();
+  for (int i = 0; i < calls; ++i) {
+    sum += call();
+  }
+  auto elapsed = clock::now() - start;
+  sink = sum;
+  return std::chrono::duration<double, std::nano>(elapsed).count() / calls;
+}
+
+struct report {
+  const char *shape;
+  size_t classes;
+  size_t pairs;
+  size_t mismatches;
+  size_t resolved; // found by type alone, with GetFunctionPointer<C>
+  size_t thunks;   // vtable entries that decode as this-adjusting thunks
+  double virtual_ns;
+  double thunk_ns;     // calling those thunks
+  double canonical_ns; // calling what they jump to instead
+  double direct_ns;    // calling the entries that are not thunks
+
+  auto finish() const -> int {
+    auto average = [](double total, size_t n) { return n ? total / n : 0.0; };
+    std::printf("%-36s %7zu %5zu %5zu %7zu %6zu %8.2f %8.2f %8.2f %8.2f\n",
+                shape, classes, pairs, mismatches, resolved, thunks,
+                average(virtual_ns, pairs), average(direct_ns, pairs - thunks),
+                average(thunk_ns, thunks), average(canonical_ns, thunks));
+    return mismatches ? 1 : 0;
+  }
+};
+
+inline void header() {
+  std::printf("%-36s %7s %5s %5s %7s %6s %8s %8s %8s %8s\n", "shape",
+              "classes", "pairs", "wrong", "by type", "thunks", "virtual",
+              "direct", "thunk", "through");
+}
+
+template <class C, class X> void check(report &r) {
+  using memfun = int (X::*)();
+  using funcptr = int (*)(X *);
+
+  C object;
+  X *x = hide(static_cast<X *>(&object));
+  memfun mf = &X::f;
+  ++r.pairs;
+
+  auto fp = stop::GetFunctionPointer(x, mf);
+  auto self = stop::GetAdjustedThisPointer(x, mf);
+  auto canonical = stop::GetCanonicalFunctionPointer(x, mf);
+  auto canonicalSelf = stop::GetCanonicalThisPointer(x, mf);
+  auto wrong = fp != (funcptr)(x->*mf) || fp(self) != C::id ||
+               canonical(canonicalSelf) != C::id;
+  if (auto byType = stop::GetFunctionPointer<C>(mf)) {
+    ++r.resolved;
+    wrong = wrong || byType != fp;
+  }
+  if (wrong) {
+    ++r.mismatches;
+    std::printf("mismatch: %s through %s\n", typeid(C).name(),
+                typeid(X).name());
+  }
+
+  r.virtual_ns += time_calls([x]() { return hide(x)->f(); });
+  auto thunk = stop::inthenameoflove::decode_thunk(
+      reinterpret_cast<uintptr_t>(fp));
+  auto direct = time_calls([fp, self]() { return hide(fp)(hide(self)); });
+  if (thunk.decoded) {
+    ++r.thunks;
+    r.thunk_ns += direct;
+    r.canonical_ns += time_calls([canonical, canonicalSelf]() {
+      return hide(canonical)(hide(canonicalSelf));
+    });
+  } else {
+    r.direct_ns += direct;
+  }
+}
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+// Just enough of an ELF reader to map addresses in the running program back
+// to the symbols that contain them, with their sizes. The dynamic linker
+// only knows exported symbols, so the executable's own .symtab is read too
+// (it is there unless the binary was stripped).
+
+#include <dlfcn.h>
+#include <elf.h>
+#include <link.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace stop {
+namespace elf {
+
+struct symbol {
+  uintptr_t address; // where it is in this process
+  size_t size;
+  std::string name; // mangled
+  bool function;
+
+  auto contains(uintptr_t a) const -> bool {
+    return a >= address && a < address + size;
+  }
+};
+
+// The sized function and object symbols of a 64-bit ELF file, relocated by
+// bias and sorted by address. Reads .symtab, or .dynsym if there is none.
+inline auto ReadSymbols(const char *path, uintptr_t bias)
+    -> std::vector<symbol> {
+  std::vector<symbol> symbols;
+  std::ifstream file(path, std::ios::binary);
+  std::vector<char> image((std::istreambuf_iterator<char>(file)),
+                          std::istreambuf_iterator<char>());
+  if (image.size() < sizeof(Elf64_Ehdr) ||
+      std::memcmp(image.data(), ELFMAG, SELFMAG) != 0 ||
+      image[EI_CLASS] != ELFCLASS64) {
+    return symbols;
+  }
+  auto *header = reinterpret_cast<const Elf64_Ehdr *>(image.data());
+  if (header->e_shoff + header->e_shnum * sizeof(Elf64_Shdr) > image.size()) {
+    return symbols;
+  }
+  auto *sections =
+      reinterpret_cast<const Elf64_Shdr *>(image.data() + header->e_shoff);
+
+  const Elf64_Shdr *table = nullptr;
+  for (Elf64_Word type : {SHT_SYMTAB, SHT_DYNSYM}) {
+    for (size_t i = 0; i < header->e_shnum && !table; ++i) {
+      if (sections[i].sh_type == type) {
+        table = &sections[i];
+      }
+    }
+  }
+  if (!table || table->sh_link >= header->e_shnum) {
+    return symbols;
+  }
+  auto &strings = sections[table->sh_link];
+  auto *first = reinterpret_cast<const Elf64_Sym *>(image.data() + table->sh_offset);
+  auto count = table->sh_size / sizeof(Elf64_Sym);
+  for (size_t i = 0; i < count; ++i) {
+    auto &s = first[i];
+    auto type = ELF64_ST_TYPE(s.st_info);
+    if ((type != STT_FUNC && type != STT_OBJECT) || s.st_size == 0 ||
+        s.st_shndx == SHN_UNDEF || s.st_name >= strings.sh_size) {
+      continue;
+    }
+    symbols.push_back({static_cast<uintptr_t>(s.st_value + bias),
+                       static_cast<size_t>(s.st_size),
+                       image.data() + strings.sh_offset + s.st_name,
+                       type == STT_FUNC});
+  }
+  std::sort(symbols.begin(), symbols.end(),
+            [](const symbol &a, const symbol &b) {
+              return a.address < b.address;
+            });
+  return symbols;
+}
+
+// The running executable's symbols, read once.
+inline auto ExecutableSymbols() -> const std::vector<symbol> & {
+  static const std::vector<symbol> symbols = [] {
+    // the first object dl_iterate_phdr reports is the executable; its
+    // dlpi_addr is the load bias (0 unless it is position independent)
+    uintptr_t bias = 0;
+    dl_iterate_phdr(
+        [](dl_phdr_info *info, size_t, void *data) {
+          *static_cast<uintptr_t *>(data) = info->dlpi_addr;
+          return 1;
+        },
+        &bias);
+    return ReadSymbols("/proc/self/exe", bias);
+  }();
+  return symbols;
+}
+
+// Find the symbol containing address: first through the dynamic linker, then
+// in the executable's static symbol table.
+inline auto FindSymbol(const void *address, symbol &found) -> bool {
+  auto a = reinterpret_cast<uintptr_t>(address);
+  Dl_info info;
+  Elf64_Sym *entry = nullptr;
+  if (dladdr1(address, &info, reinterpret_cast<void **>(&entry),
+              RTLD_DL_SYMENT) &&
+      info.dli_sname && entry) {
+    symbol s = {reinterpret_cast<uintptr_t>(info.dli_saddr),
+                static_cast<size_t>(entry->st_size), info.dli_sname,
+                ELF64_ST_TYPE(entry->st_info) == STT_FUNC};
+    if (s.contains(a)) {
+      found = s;
+      return true;
+    }
+  }
+  auto &symbols = ExecutableSymbols();
+  auto after = std::upper_bound(
+      symbols.begin(), symbols.end(), a,
+      [](uintptr_t a, const symbol &s) { return a < s.address; });
+  if (after != symbols.begin() && std::prev(after)->contains(a)) {
+    found = *std::prev(after);
+    return true;
+  }
+  return false;
+}
+
+// Find a symbol by its mangled name: exported ones through the dynamic
+// linker, anything else in the executable's static symbol table.
+inline auto FindSymbolByName(const std::string &name, symbol &found) -> bool {
+  if (auto *address = dlsym(RTLD_DEFAULT, name.c_str())) {
+    if (FindSymbol(address, found) && found.name == name) {
+      return true;
+    }
+  }
+  for (auto &s : ExecutableSymbols()) {
+    if (s.name == name) {
+      found = s;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Where the module containing address is loaded, so addresses can be made
+// independent of ASLR.
+inline auto ModuleBase(const void *address) -> uintptr_t {
+  Dl_info info;
+  if (dladdr(address, &info) && info.dli_fbase) {
+    return reinterpret_cast<uintptr_t>(info.dli_fbase);
+  }
+  return 0;
+}
+};
+};
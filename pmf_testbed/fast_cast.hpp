@@ -0,0 +1,99 @@
+#pragma once
+
+#include "overrides.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace stop {
+
+namespace inthenameoflove {
+
+// The dynamic_cast results for one (source, target) type pair, by the vptr of
+// the source subobject. Where a subobject sits in its complete object, and so
+// where the target is from it, depends only on that vptr: each base
+// subobject of each dynamic type has its own vtable address point.
+//
+// Each entry is one word, vptr << 16 | offset, so a reader never sees a vptr
+// with another vptr's offset and the table needs no lock. That needs vptrs
+// below 2^48 (true of x86-64 and AArch64 user space) and offsets that fit in
+// 16 bits; results that do not fit are not cached. A collision overwrites.
+template <class From, class To, size_t Size = 256> struct cast_cache {
+  static_assert((Size & (Size - 1)) == 0, "Size must be a power of two");
+  static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "needs lock-free 64-bit atomics");
+
+  // the offset recorded for a failed cast
+  static const ptrdiff_t failed = INT16_MIN;
+
+  static auto find(const void *vptr, ptrdiff_t &offset) -> bool {
+    auto word = entries[slot(vptr)].load(std::memory_order_relaxed);
+    if ((word >> 16) != reinterpret_cast<uintptr_t>(vptr)) {
+      return false;
+    }
+    offset = static_cast<int16_t>(word & 0xffff);
+    return true;
+  }
+
+  static void store(const void *vptr, ptrdiff_t offset) {
+    auto key = reinterpret_cast<uintptr_t>(vptr);
+    if ((key >> 48) != 0 || offset < INT16_MIN || offset > INT16_MAX) {
+      return;
+    }
+    auto word = key << 16 | static_cast<uint16_t>(offset);
+    entries[slot(vptr)].store(word, std::memory_order_relaxed);
+  }
+
+  static auto slot(const void *vptr) -> size_t {
+    auto bits = reinterpret_cast<uintptr_t>(vptr);
+    return ((bits >> 3) ^ (bits >> 11)) & (Size - 1);
+  }
+
+  // zero never matches: no vtable is at address 0
+  static std::atomic<uint64_t> entries[Size];
+};
+
+template <class From, class To, size_t Size>
+std::atomic<uint64_t> cast_cache<From, To, Size>::entries[Size];
+
+template <class From, class To, size_t Size>
+const ptrdiff_t cast_cache<From, To, Size>::failed;
+};
+
+// dynamic_cast<To>(p) for a pointer type To, remembered per vptr. A hit is a
+// vptr load, a load from the cache and an add; only the first cast from each
+// (dynamic type, subobject) goes through dynamic_cast. Safe to call from any
+// number of threads.
+template <class To, class From> auto fast_cast(From *p) -> To {
+  static_assert(std::is_pointer<To>::value, "fast_cast<T *>(p)");
+  static_assert(std::is_polymorphic<From>::value,
+                "fast_cast needs a polymorphic source type");
+  using cache = inthenameoflove::cast_cache<
+      typename std::remove_cv<From>::type,
+      typename std::remove_cv<typename std::remove_pointer<To>::type>::type>;
+
+  if (!p) {
+    return nullptr;
+  }
+  auto *vptr = get_vptr(p);
+  ptrdiff_t offset;
+  if (!cache::find(vptr, offset)) {
+    auto result = dynamic_cast<To>(p);
+    if (!result) {
+      cache::store(vptr, cache::failed);
+      return nullptr;
+    }
+    offset = reinterpret_cast<const volatile char *>(result) -
+             reinterpret_cast<const volatile char *>(p);
+    if (offset != cache::failed) {
+      cache::store(vptr, offset);
+    }
+    return result;
+  }
+  if (offset == cache::failed) {
+    return nullptr;
+  }
+  return reinterpret_cast<To>(reinterpret_cast<uintptr_t>(p) + offset);
+}
+};
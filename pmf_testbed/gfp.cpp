@@ -5,6 +5,13 @@
 
 // All the magic and horror is here
 #include "gfp.hpp"
+#include "overrides.hpp"
+#include "vtable.hpp"
+#include "icf.hpp"
+#include "unified_call_cast.hpp"
+#include "fast_cast.hpp"
+
+#include <unordered_map>
 
 uintptr_t f(int, char, float) {
 // MAGIC
@@ -140,10 +147,8 @@ float c_;
 }
 ;
 
-#if 0
-// I don't think this is possible... The *compiler* knows, but it won't tell
-// me without GCC's extension, and I don't know how to say "Give me the vtable
-// you would construct for C", without constructing C.
+// The *compiler* knows, but it won't tell without GCC's extension, so the
+// vtable it would construct for A is looked up from A's _ZTV symbol.
 WHEN("the member function's address is extracted without an object") {
   auto extractedFP = stop::GetFunctionPointer(&A::f);
   auto extractedFPval = reinterpret_cast<uintptr_t>(extractedFP);
@@ -163,7 +168,6 @@ WHEN("the member function's address is extracted without an object") {
     REQUIRE(extractedFPval == realFP);
   }
 }
-#endif
 
 WHEN("the member function's address is extracted with an object") {
   auto a = A{};
@@ -427,6 +431,11 @@ GIVEN("a complex subclass that overrides the member function") {
       auto realFP = b.f(0, 'a', 1.f);
       REQUIRE(extractedFPval == realFP);
     }
+    THEN("parsing the thunk finds the self-determined address") {
+      auto canonicalFP = stop::GetCanonicalFunctionPointer(&b, &A::f);
+      auto realFP = b.f(0, 'a', 1.f);
+      REQUIRE(reinterpret_cast<uintptr_t>(canonicalFP) == realFP);
+    }
 
     AND_WHEN("the object pointer is adjusted for the call") {
       auto adjusted_bp = stop::GetAdjustedThisPointer(&b, &A::f);
@@ -458,3 +467,1447 @@ GIVEN("a complex subclass that overrides the member function") {
 }
 }
 ;
+
+SCENARIO("Virtual functions past the first vtable slot can be extracted",
+         "[pmf-virt-extract]") {
+  GIVEN("a class with several virtual member functions") {
+    class A {
+    public:
+      virtual int f() { return 1; }
+      virtual int g() { return 2; }
+      virtual int h() { return 3; }
+    };
+    class B : public A {
+    public:
+      int h() override { return 4; }
+    };
+    WHEN("the last one is extracted with an object") {
+      auto b = B{};
+      auto extractedFP = stop::GetFunctionPointer(&b, &A::h);
+      THEN("calling it reaches the final overrider") {
+        REQUIRE(extractedFP(&b) == 4);
+      }
+    }
+    WHEN("a middle one is extracted with an object") {
+      auto b = B{};
+      auto extractedFP = stop::GetFunctionPointer(&b, &A::g);
+      THEN("calling it reaches the inherited version") {
+        REQUIRE(extractedFP(&b) == 2);
+      }
+    }
+  }
+}
+
+SCENARIO("Override detection tells whether a dynamic type overrides a method",
+         "[override]") {
+  GIVEN("an entity hierarchy with vanilla and customised subclasses") {
+    class Walker {
+    public:
+      virtual ~Walker() {}
+      virtual int Update() { return 0; }
+      virtual int Speed() { return 1; }
+    };
+    class Vanilla : public Walker {};
+    class CustomUpdate : public Walker {
+    public:
+      int Update() override { return 2; }
+    };
+    class CustomSpeed : public Walker {
+    public:
+      int Speed() override { return 3; }
+    };
+    class Intrusive {
+    public:
+      virtual void set(int x) { bananas_ = x; }
+      int bananas_;
+    };
+    class SecondBase : public Intrusive, public Walker {
+    public:
+      int Update() override { return 4; }
+    };
+    class SecondBaseVanilla : public Intrusive, public Walker {};
+
+    auto prototype = Walker{};
+    auto updates = stop::MakeOverrideQuery(&Walker::Update, &prototype);
+    auto speeds = stop::MakeOverrideQuery(&Walker::Speed, &prototype);
+
+    auto vanilla = Vanilla{};
+    auto customUpdate = CustomUpdate{};
+    auto customSpeed = CustomSpeed{};
+    auto secondBase = SecondBase{};
+    auto secondBaseVanilla = SecondBaseVanilla{};
+
+    WHEN("the reference type itself is queried") {
+      THEN("it does not override") {
+        REQUIRE_FALSE(updates.overrides(&prototype));
+        REQUIRE_FALSE(speeds.overrides(&prototype));
+      }
+    }
+    WHEN("each subclass is queried") {
+      THEN("only the methods it overrides are reported") {
+        REQUIRE_FALSE(updates.overrides(&vanilla));
+        REQUIRE_FALSE(speeds.overrides(&vanilla));
+        REQUIRE(updates.overrides(&customUpdate));
+        REQUIRE_FALSE(speeds.overrides(&customUpdate));
+        REQUIRE_FALSE(updates.overrides(&customSpeed));
+        REQUIRE(speeds.overrides(&customSpeed));
+      }
+    }
+    WHEN("the base is not the first in the object") {
+      THEN("an override reached through a thunk is reported") {
+        REQUIRE(updates.overrides(&secondBase));
+      }
+      THEN("inheriting the method is not reported") {
+        REQUIRE_FALSE(updates.overrides(&secondBaseVanilla));
+      }
+    }
+    WHEN("the same types are queried again from the cache") {
+      for (int i = 0; i < 2; ++i) {
+        updates.overrides(&vanilla);
+        updates.overrides(&customUpdate);
+      }
+      THEN("the answers do not change") {
+        REQUIRE_FALSE(updates.overrides(&vanilla));
+        REQUIRE(updates.overrides(&customUpdate));
+        auto another = CustomUpdate{};
+        REQUIRE(updates.overrides(&another));
+      }
+    }
+#if (__GNUC__ && __cplusplus) && !__clang__
+    WHEN("the reference comes from the gcc extension") {
+      using fp_t = int (*)(Walker *);
+      auto query = stop::override_query<int (Walker::*)()>(
+          &Walker::Update, reinterpret_cast<fp_t>(&Walker::Update));
+      THEN("it agrees with the prototype's reference") {
+        REQUIRE(query.reference() == updates.reference());
+        REQUIRE(query.overrides(&customUpdate));
+        REQUIRE_FALSE(query.overrides(&vanilla));
+      }
+    }
+#endif
+  }
+  GIVEN("a hierarchy whose method is const, or otherwise qualified") {
+    class Walker {
+    public:
+      virtual ~Walker() {}
+      virtual int Update(float) const { return 0; }
+      virtual int Speed() const volatile noexcept { return 1; }
+      virtual int Reset() & { return 2; }
+    };
+    class Vanilla : public Walker {};
+    class Custom : public Walker {
+    public:
+      int Update(float) const override { return 3; }
+      int Speed() const volatile noexcept override { return 4; }
+      int Reset() & override { return 5; }
+    };
+
+    const auto prototype = Walker{};
+    auto updates = stop::MakeOverrideQuery(&Walker::Update, &prototype);
+    auto speeds = stop::MakeOverrideQuery(&Walker::Speed, &prototype);
+    auto resets = stop::override_query<int (Walker::*)() &>(
+        &Walker::Reset, const_cast<Walker *>(&prototype));
+
+    const auto vanilla = Vanilla{};
+    const auto custom = Custom{};
+
+    WHEN("const objects are queried") {
+      THEN("only the overriding type is reported") {
+        REQUIRE_FALSE(updates.overrides(&prototype));
+        REQUIRE_FALSE(updates.overrides(&vanilla));
+        REQUIRE(updates.overrides(&custom));
+        REQUIRE_FALSE(speeds.overrides(&vanilla));
+        REQUIRE(speeds.overrides(&custom));
+      }
+    }
+    WHEN("a ref-qualified method is queried") {
+      auto mutableCustom = Custom{};
+      auto mutableVanilla = Vanilla{};
+      THEN("only the overriding type is reported") {
+        REQUIRE_FALSE(resets.overrides(&mutableVanilla));
+        REQUIRE(resets.overrides(&mutableCustom));
+      }
+    }
+  }
+}
+
+SCENARIO("Override signatures route objects by which methods they override",
+         "[override]") {
+  GIVEN("a hierarchy where fast paths depend on several methods") {
+    class Mover {
+    public:
+      virtual ~Mover() {}
+      virtual int ComputeVelocity() { return 0; }
+    };
+    class Animated {
+    public:
+      virtual ~Animated() {}
+      virtual int Animate() { return 0; }
+    };
+    class Entity : public Mover, public Animated {
+    public:
+      virtual int Update() { return 0; }
+    };
+    class Vanilla : public Entity {};
+    class CustomUpdate : public Entity {
+    public:
+      int Update() override { return 1; }
+    };
+    class CustomAnimate : public Entity {
+    public:
+      int Animate() override { return 2; }
+    };
+    class CustomAll : public Entity {
+    public:
+      int Update() override { return 1; }
+      int ComputeVelocity() override { return 3; }
+      int Animate() override { return 2; }
+    };
+
+    auto prototype = Entity{};
+    stop::override_signature<Entity> signature(
+        &prototype, &Entity::Update, &Mover::ComputeVelocity,
+        &Animated::Animate);
+
+    auto vanilla = Vanilla{};
+    auto customUpdate = CustomUpdate{};
+    auto customAnimate = CustomAnimate{};
+    auto customAll = CustomAll{};
+
+    WHEN("each type's mask is computed") {
+      THEN("one bit is set per overridden method, in signature order") {
+        REQUIRE(signature.size() == 3);
+        REQUIRE(signature.mask(&prototype) == 0);
+        REQUIRE(signature.mask(&vanilla) == 0);
+        REQUIRE(signature.mask(&customUpdate) == 1);
+        REQUIRE(signature.mask(&customAnimate) == 4);
+        REQUIRE(signature.mask(&customAll) == 7);
+      }
+      THEN("asking again gives the cached mask") {
+        signature.mask(&customAll);
+        REQUIRE(signature.mask(&customAll) == 7);
+        REQUIRE(signature.vanilla(&vanilla));
+        REQUIRE_FALSE(signature.vanilla(&customAnimate));
+      }
+    }
+    WHEN("a container of entities is partitioned on the signature") {
+      std::vector<Entity *> entities = {&customAll, &vanilla, &customUpdate,
+                                        &prototype, &customAnimate, &vanilla};
+      auto end = stop::PartitionVanilla(entities.begin(), entities.end(),
+                                        signature);
+      THEN("the vanilla objects come first") {
+        REQUIRE(end - entities.begin() == 3);
+        REQUIRE(entities[0] == &vanilla);
+        REQUIRE(entities[1] == &prototype);
+        REQUIRE(entities[2] == &vanilla);
+      }
+    }
+    WHEN("a container of entities is grouped by signature") {
+      std::vector<Entity *> entities = {&customAll, &vanilla, &customAnimate,
+                                        &customUpdate, &customAll};
+      stop::GroupBySignature(entities.begin(), entities.end(), signature);
+      THEN("objects with the same mask are contiguous, in mask order") {
+        REQUIRE(entities[0] == &vanilla);
+        REQUIRE(entities[1] == &customUpdate);
+        REQUIRE(entities[2] == &customAnimate);
+        REQUIRE(entities[3] == &customAll);
+        REQUIRE(entities[4] == &customAll);
+      }
+    }
+  }
+  GIVEN("methods that are const or otherwise qualified") {
+    class Mover {
+    public:
+      virtual ~Mover() {}
+      virtual int ComputeVelocity(float) const { return 0; }
+    };
+    class Entity : public Mover {
+    public:
+      virtual void Update(float) const {}
+      virtual int Animate() volatile noexcept { return 0; }
+    };
+    class Vanilla : public Entity {};
+    class CustomUpdate : public Entity {
+    public:
+      void Update(float) const override {}
+    };
+    class CustomAll : public Entity {
+    public:
+      void Update(float) const override {}
+      int ComputeVelocity(float) const override { return 1; }
+      int Animate() volatile noexcept override { return 2; }
+    };
+
+    auto prototype = Entity{};
+    stop::override_signature<Entity> signature(
+        &prototype, &Entity::Update, &Mover::ComputeVelocity,
+        &Entity::Animate);
+
+    auto vanilla = Vanilla{};
+    auto customUpdate = CustomUpdate{};
+    auto customAll = CustomAll{};
+
+    WHEN("each type's mask is computed") {
+      THEN("the qualified methods are compared like any other") {
+        REQUIRE(signature.size() == 3);
+        REQUIRE(signature.mask(&prototype) == 0);
+        REQUIRE(signature.mask(&vanilla) == 0);
+        REQUIRE(signature.mask(&customUpdate) == 1);
+        REQUIRE(signature.mask(&customAll) == 7);
+      }
+    }
+  }
+}
+
+SCENARIO("Vtables of live objects can be enumerated and hashed",
+         "[vtable]") {
+  GIVEN("a small hierarchy with single and multiple inheritance") {
+    class A {
+    public:
+      virtual ~A() {}
+      virtual int f() { return 1; }
+      virtual int g() { return 2; }
+    };
+    class Same : public A {};
+    class Other : public A {
+    public:
+      int g() override { return 3; }
+    };
+    class Intrusive {
+    public:
+      virtual ~Intrusive() {}
+      virtual void set(int x) { bananas_ = x; }
+      int bananas_;
+    };
+    class Both : public Intrusive, public A {
+    public:
+      virtual int h() { return 4; }
+    };
+
+    auto a = A{};
+    auto same = Same{};
+    auto other = Other{};
+    auto both = Both{};
+
+    WHEN("the vtable of a single-inheritance object is read") {
+      auto vtable = stop::GetVtable(&a);
+      THEN("its extent comes from the _ZTV symbol") {
+        // two destructor entries, f and g
+        REQUIRE(vtable.size == 4);
+        REQUIRE(vtable.symbol.compare(0, 4, "_ZTV") == 0);
+        REQUIRE(vtable.rtti() == reinterpret_cast<uintptr_t>(&typeid(A)));
+      }
+      THEN("its slots are the virtual functions in declaration order") {
+        auto memf = &A::g;
+        REQUIRE(vtable[3] == reinterpret_cast<uintptr_t>(
+                                 stop::GetFunctionPointer(&a, memf)));
+      }
+    }
+    WHEN("the primary vtable of a multiple-inheritance object is read") {
+      auto vtable = stop::GetVtable(&both);
+      THEN("enumeration stops at the secondary vtable") {
+        // Intrusive's destructors and set, then Both's new h; f and g are
+        // only in the secondary vtable for A
+        REQUIRE(vtable.size == 4);
+      }
+    }
+    WHEN("objects are grouped by vtable hash") {
+      stop::vtable_identity identity;
+      THEN("a derived type's own destructor makes it hash differently") {
+        REQUIRE(identity.key(&a) != identity.key(&same));
+      }
+      THEN("a type with an override hashes differently") {
+        REQUIRE(identity.key(&a) != identity.key(&other));
+      }
+    }
+  }
+  GIVEN("a hierarchy without virtual destructors") {
+    class P {
+    public:
+      virtual int f() { return 1; }
+      virtual int g() { return 2; }
+    };
+    class Same : public P {};
+    class Other : public P {
+    public:
+      int g() override { return 3; }
+    };
+    auto p = P{};
+    auto same = Same{};
+    auto other = Other{};
+    WHEN("objects are grouped by vtable hash") {
+      stop::vtable_identity identity;
+      THEN("types that inherit everything hash the same") {
+        REQUIRE(stop::GetVtable(&p).hash() == stop::GetVtable(&same).hash());
+        REQUIRE(identity.key(&p) == identity.key(&same));
+      }
+      THEN("their vtables are still distinct objects") {
+        REQUIRE(stop::GetVtable(&p).table != stop::GetVtable(&same).table);
+      }
+      THEN("a type with an override hashes differently") {
+        REQUIRE(identity.key(&p) != identity.key(&other));
+      }
+    }
+  }
+  GIVEN("a diamond through a virtual base") {
+    class VB {
+    public:
+      virtual int f() { return 0; }
+      int b = 0;
+    };
+    class VM1 : public virtual VB {
+    public:
+      int f() override { return 1; }
+      virtual int m1() { return 1; }
+    };
+    class VM2 : public virtual VB {
+    public:
+      int f() override { return 2; }
+      virtual int m2() { return 2; }
+    };
+    class VD : public VM1, public VM2 {
+    public:
+      int f() override { return 3; }
+    };
+    auto d = VD{};
+    auto isCode = [](uintptr_t slot) {
+      return stop::elf::ModuleBase(reinterpret_cast<void *>(slot)) != 0;
+    };
+
+    WHEN("the primary vtable is read") {
+      auto vtable = stop::GetVtable(&d);
+      THEN("enumeration stops before the next table's vbase offsets") {
+        // VD's f and VM1's m1
+        REQUIRE(vtable.size == 2);
+        for (auto slot : vtable) {
+          REQUIRE(isCode(slot));
+        }
+      }
+      THEN("the secondary tables are found too") {
+        // VM2-in-VD and VB-in-VD
+        REQUIRE(vtable.group.size() == 3);
+        REQUIRE(vtable.group[0].table == vtable.table);
+        for (auto &t : vtable.group) {
+          for (size_t i = 0; i < t.size; ++i) {
+            REQUIRE(isCode(t.table[i]));
+          }
+        }
+      }
+    }
+    WHEN("the vtable of the virtual base subobject is read") {
+      VB *base = &d;
+      auto vtable = stop::GetVtable(base);
+      THEN("it is one of the group's tables, holding the thunk for f") {
+        auto memf = &VB::f;
+        REQUIRE(vtable.size == 1);
+        REQUIRE(vtable.group.back().table == vtable.table);
+        REQUIRE(vtable[0] == reinterpret_cast<uintptr_t>(
+                                 stop::GetFunctionPointer(base, memf)));
+        REQUIRE(vtable.hash() == stop::GetVtable(&d).hash());
+      }
+    }
+  }
+  GIVEN("types that differ only in a secondary vtable") {
+    class Intrusive {
+    public:
+      virtual int set() { return 0; }
+      int bananas_;
+    };
+    class P {
+    public:
+      virtual int g() { return 0; }
+      virtual int h() { return 0; }
+    };
+    class P2 : public P {
+    public:
+      int h() override { return 2; }
+    };
+    class P3 : public P {
+    public:
+      int h() override { return 3; }
+    };
+    class S2 : public Intrusive, public P2 {};
+    class S3 : public Intrusive, public P3 {};
+    auto s2 = S2{};
+    auto s3 = S3{};
+    WHEN("they are hashed") {
+      auto v2 = stop::GetVtable(&s2);
+      auto v3 = stop::GetVtable(&s3);
+      THEN("the primary tables agree but the hashes do not") {
+        REQUIRE(v2.size == 1);
+        REQUIRE(v2[0] == v3[0]);
+        REQUIRE(v2.hash() != v3.hash());
+      }
+    }
+  }
+}
+
+SCENARIO("Virtual functions can be resolved for a type without an object",
+         "[pmf-virt-extract]") {
+  GIVEN("an abstract base and concrete subclasses") {
+    class Abstract {
+    public:
+      virtual ~Abstract() {}
+      virtual int f() = 0;
+      virtual int g() { return 1; }
+    };
+    class Concrete : public Abstract {
+    public:
+      int f() override { return 2; }
+    };
+    class Intrusive {
+    public:
+      virtual ~Intrusive() {}
+      virtual void set(int x) { bananas_ = x; }
+      int bananas_;
+    };
+    class Second : public Intrusive, public Abstract {
+    public:
+      int f() override { return 3; }
+    };
+    // vtables are only emitted for types that are constructed somewhere
+    auto concrete = Concrete{};
+    auto second = Second{};
+
+    WHEN("the pure function is resolved for the abstract type") {
+      THEN("there is no function to call") {
+        REQUIRE(stop::GetFunctionPointer(&Abstract::f) == nullptr);
+      }
+    }
+    WHEN("an inherited function is resolved for the abstract type") {
+      auto extractedFP = stop::GetFunctionPointer(&Abstract::g);
+      THEN("it is the base's version") {
+        REQUIRE(extractedFP != nullptr);
+        REQUIRE(extractedFP(&concrete) == 1);
+      }
+    }
+    WHEN("the function is resolved for a subclass") {
+      auto extractedFP = stop::GetFunctionPointer<Concrete>(&Abstract::f);
+      THEN("it is the final overrider, as found through an object") {
+        REQUIRE(extractedFP == stop::GetFunctionPointer(&concrete, &Abstract::f));
+        REQUIRE(extractedFP(&concrete) == 2);
+      }
+    }
+    WHEN("the base is not the first in the subclass") {
+      auto extractedFP = stop::GetFunctionPointer<Second>(&Abstract::f);
+      THEN("it is the same thunk the object's vtable holds") {
+        REQUIRE(extractedFP == stop::GetFunctionPointer(&second, &Abstract::f));
+        REQUIRE(extractedFP(static_cast<Abstract *>(&second)) == 3);
+      }
+    }
+  }
+  GIVEN("a virtual base") {
+    class Root {
+    public:
+      virtual ~Root() {}
+      virtual int f() { return 1; }
+    };
+    class Left : public virtual Root {};
+    auto left = Left{};
+    WHEN("the function is resolved from the symbol alone") {
+      THEN("the subobject cannot be located, so nothing is returned") {
+        REQUIRE(stop::GetFunctionPointer<Left>(&Root::f) == nullptr);
+      }
+    }
+    WHEN("a prototype is registered for the type") {
+      stop::RegisterPrototype(&left);
+      auto extractedFP = stop::GetFunctionPointer<Left>(&Root::f);
+      stop::RegisterPrototype<Left>(nullptr);
+      THEN("the prototype's vtable resolves it") {
+        REQUIRE(extractedFP == stop::GetFunctionPointer(&left, &Root::f));
+      }
+    }
+  }
+}
+
+namespace {
+enum class shape_t { base, mid1, mid2, derived };
+}
+
+SCENARIO("Devirtualised functions are callable through the adjusted this in "
+         "every hierarchy shape",
+         "[pmf-adjust]") {
+  GIVEN("a diamond hierarchy with a non-virtual member function") {
+    class B {
+    public:
+      shape_t f() { return tag_; }
+      shape_t tag_ = shape_t::base;
+    };
+    class M1 : public B {
+    public:
+      M1() { tag_ = shape_t::mid1; }
+    };
+    class M2 : public B {
+    public:
+      M2() { tag_ = shape_t::mid2; }
+    };
+    class D : public M1, public M2 {};
+    WHEN("the function is reached through the second middle layer") {
+      using fTM2 = shape_t (M2::*)();
+      using fTD = shape_t (D::*)();
+      // adj carries the offset of M2 in D
+      fTD memp = static_cast<fTM2>(&B::f);
+      auto d = D{};
+      auto fp = stop::GetFunctionPointer(&d, memp);
+      auto self = stop::GetAdjustedThisPointer(&d, memp);
+      THEN("the adjusted this is the M2 subobject") {
+        REQUIRE(reinterpret_cast<void *>(self) ==
+                static_cast<void *>(static_cast<M2 *>(&d)));
+      }
+      THEN("the direct call acts on that subobject") {
+        REQUIRE(fp(self) == shape_t::mid2);
+        REQUIRE(fp(self) == (d.*memp)());
+      }
+    }
+  }
+  GIVEN("a diamond hierarchy with a virtual member function") {
+    class B {
+    public:
+      virtual ~B() {}
+      virtual shape_t f() { return shape_t::base; }
+    };
+    class M1 : public B {};
+    class M2 : public B {
+    public:
+      shape_t f() override { return shape_t::mid2; }
+    };
+    class D : public M1, public M2 {};
+    WHEN("the virtual function is reached through the second middle layer") {
+      using fTM2 = shape_t (M2::*)();
+      using fTD = shape_t (D::*)();
+      fTD memp = static_cast<fTM2>(&M2::f);
+      auto d = D{};
+      auto fp = stop::GetFunctionPointer(&d, memp);
+      auto self = stop::GetAdjustedThisPointer(&d, memp);
+      THEN("the vtable of the M2 subobject supplies the function") {
+        REQUIRE(fp(self) == shape_t::mid2);
+        REQUIRE(fp(self) == (d.*memp)());
+      }
+#if (__GNUC__ && __cplusplus) && !__clang__
+      THEN("it matches the gcc extension's result") {
+        using fp_t = shape_t (*)(D *);
+        REQUIRE(reinterpret_cast<uintptr_t>(fp) ==
+                reinterpret_cast<uintptr_t>(reinterpret_cast<fp_t>(d.*memp)));
+      }
+#endif
+    }
+    WHEN("the virtual function is reached through the first middle layer") {
+      using fTM1 = shape_t (M1::*)();
+      fTM1 memp = &M1::f;
+      auto d = D{};
+      auto fp = stop::GetFunctionPointer(&d, memp);
+      auto self = stop::GetAdjustedThisPointer(&d, memp);
+      THEN("it is the inherited base version") {
+        REQUIRE(fp(self) == shape_t::base);
+      }
+    }
+  }
+  GIVEN("a virtual-base hierarchy with a non-virtual member function") {
+    class B {
+    public:
+      shape_t f() { return tag_; }
+      shape_t tag_ = shape_t::base;
+    };
+    class M1 : public virtual B {
+    public:
+      int m1_ = 1;
+    };
+    class M2 : public virtual B {
+    public:
+      int m2_ = 2;
+    };
+    class D : public M1, public M2 {
+    public:
+      D() { tag_ = shape_t::derived; }
+    };
+    WHEN("the base function is called on the derived object") {
+      auto d = D{};
+      auto fp = stop::GetFunctionPointer(&d, &B::f);
+      auto self = stop::GetAdjustedThisPointer(&d, &B::f);
+      THEN("the adjusted this is the shared virtual base") {
+        REQUIRE(self == static_cast<B *>(&d));
+        REQUIRE(reinterpret_cast<void *>(self) != static_cast<void *>(&d));
+        REQUIRE(fp(self) == shape_t::derived);
+      }
+    }
+  }
+  GIVEN("a virtual-base hierarchy with a virtual member function") {
+    class B {
+    public:
+      virtual ~B() {}
+      virtual shape_t f() { return shape_t::base; }
+      int b_ = 0;
+    };
+    class M1 : public virtual B {
+    public:
+      shape_t f() override { return shape_t::mid1; }
+      int m1_ = 1;
+    };
+    class M2 : public virtual B {
+    public:
+      int m2_ = 2;
+    };
+    class D : public M1, public M2 {
+    public:
+      shape_t f() override { return i_ == 60 ? shape_t::derived : shape_t::base; }
+      int i_ = 60;
+    };
+    WHEN("the virtual base's function is called on the derived object") {
+      auto d = D{};
+      auto fp = stop::GetFunctionPointer(&d, &B::f);
+      auto self = stop::GetAdjustedThisPointer(&d, &B::f);
+      THEN("the virtual thunk in B's vtable reaches the final overrider") {
+        REQUIRE(self == static_cast<B *>(&d));
+        REQUIRE(fp(self) == shape_t::derived);
+      }
+    }
+    WHEN("a middle layer's override is called on the derived object") {
+      using fTM1 = shape_t (M1::*)();
+      fTM1 memp = &M1::f;
+      auto d = D{};
+      auto fp = stop::GetFunctionPointer(&d, memp);
+      auto self = stop::GetAdjustedThisPointer(&d, memp);
+      THEN("it also reaches the final overrider") {
+        REQUIRE(fp(self) == shape_t::derived);
+      }
+    }
+    WHEN("the complete object is found from the virtual base") {
+      auto d = D{};
+      B *b = &d;
+      THEN("offset-to-top leads back to it") {
+        REQUIRE(stop::inthenameoflove::get_complete_object(b) ==
+                static_cast<void *>(&d));
+      }
+    }
+  }
+}
+
+SCENARIO("This-adjusting thunks are resolved to their target", "[thunk]") {
+  GIVEN("hand-assembled thunks") {
+    // the decoder only reads these, they are never executed
+    WHEN("a thunk subtracts an 8-bit constant and jumps short") {
+      const unsigned char code[] = {0x48, 0x83, 0xef, 0x10, 0xeb, 0x10};
+      auto thunk = stop::inthenameoflove::decode_thunk(
+          reinterpret_cast<uintptr_t>(code));
+      THEN("the adjustment and target are decoded") {
+        REQUIRE(thunk.decoded);
+        REQUIRE(thunk.offset == -16);
+        REQUIRE(thunk.vcall == 0);
+        REQUIRE(thunk.target == reinterpret_cast<uintptr_t>(code + 6 + 0x10));
+      }
+    }
+    WHEN("a thunk with endbr64 adds a 32-bit constant and jumps near") {
+      const unsigned char code[] = {0xf3, 0x0f, 0x1e, 0xfa, 0x48, 0x81, 0xc7,
+                                    0x00, 0x01, 0x00, 0x00, 0xe9, 0xf0, 0xff,
+                                    0xff, 0xff};
+      auto thunk = stop::inthenameoflove::decode_thunk(
+          reinterpret_cast<uintptr_t>(code));
+      THEN("the adjustment and a backwards target are decoded") {
+        REQUIRE(thunk.decoded);
+        REQUIRE(thunk.offset == 256);
+        REQUIRE(thunk.target == reinterpret_cast<uintptr_t>(code + 16 - 16));
+      }
+    }
+    WHEN("a virtual thunk reads a 32-bit vcall offset") {
+      const unsigned char code[] = {0x4c, 0x8b, 0x17, 0x49, 0x03, 0xba, 0x00,
+                                    0xff, 0xff, 0xff, 0xeb, 0x00};
+      auto thunk = stop::inthenameoflove::decode_thunk(
+          reinterpret_cast<uintptr_t>(code));
+      THEN("the vcall offset is decoded") {
+        REQUIRE(thunk.decoded);
+        REQUIRE(thunk.offset == 0);
+        REQUIRE(thunk.vcall == -256);
+        REQUIRE(thunk.target == reinterpret_cast<uintptr_t>(code + 12));
+      }
+    }
+    WHEN("a virtual thunk reads an 8-bit vcall offset through %rax") {
+      // Clang's form: mov (%rdi),%rax; add -24(%rax),%rdi; jmp
+      const unsigned char code[] = {0x48, 0x8b, 0x07, 0x48, 0x03,
+                                    0x78, 0xe8, 0xeb, 0x02};
+      auto thunk = stop::inthenameoflove::decode_thunk(
+          reinterpret_cast<uintptr_t>(code));
+      THEN("the vcall offset is decoded") {
+        REQUIRE(thunk.decoded);
+        REQUIRE(thunk.offset == 0);
+        REQUIRE(thunk.vcall == -24);
+        REQUIRE(thunk.target == reinterpret_cast<uintptr_t>(code + 9 + 2));
+      }
+    }
+    WHEN("a thunk adjusts by a constant, then a 32-bit vcall offset through "
+         "%rax") {
+      const unsigned char code[] = {0xf3, 0x0f, 0x1e, 0xfa, 0x48, 0x83, 0xc7,
+                                    0x08, 0x48, 0x8b, 0x07, 0x48, 0x03, 0xb8,
+                                    0x00, 0xfe, 0xff, 0xff, 0xe9, 0x00, 0x01,
+                                    0x00, 0x00};
+      auto thunk = stop::inthenameoflove::decode_thunk(
+          reinterpret_cast<uintptr_t>(code));
+      THEN("both adjustments are decoded") {
+        REQUIRE(thunk.decoded);
+        REQUIRE(thunk.offset == 8);
+        REQUIRE(thunk.vcall == -512);
+        REQUIRE(thunk.target == reinterpret_cast<uintptr_t>(code + 23 + 256));
+      }
+    }
+    WHEN("the code is an ordinary function") {
+      const unsigned char code[] = {0x55, 0x48, 0x89, 0xe5, 0xc3};
+      auto thunk = stop::inthenameoflove::decode_thunk(
+          reinterpret_cast<uintptr_t>(code));
+      THEN("it is not a thunk") {
+        REQUIRE_FALSE(thunk.decoded);
+        REQUIRE(thunk.target == reinterpret_cast<uintptr_t>(code));
+      }
+    }
+  }
+  GIVEN("a class that picks up a secondary base") {
+    class A {
+    public:
+      virtual ~A() {}
+      virtual int f() { return 1; }
+      int a_ = 0;
+    };
+    class Plain : public A {
+    public:
+      int f() override { return a_ + 2; }
+    };
+    class Intrusive {
+    public:
+      virtual ~Intrusive() {}
+      virtual void set(int x) { bananas_ = x; }
+      int bananas_;
+    };
+    class Secondary : public Intrusive, public A {
+    public:
+      int f() override { return a_ + 3; }
+    };
+    auto plain = Plain{};
+    auto secondary = Secondary{};
+    secondary.a_ = 10;
+
+    WHEN("the override is found through the secondary vtable") {
+      auto thunkFP = stop::GetFunctionPointer(&secondary, &A::f);
+      auto canonicalFP = stop::GetCanonicalFunctionPointer(&secondary, &A::f);
+      THEN("the thunk and its target differ") {
+        REQUIRE(thunkFP != canonicalFP);
+      }
+#if (__GNUC__ && __cplusplus) && !__clang__
+      THEN("the target is the overrider itself") {
+        using fp_t = int (*)(Secondary *);
+        REQUIRE(reinterpret_cast<uintptr_t>(canonicalFP) ==
+                reinterpret_cast<uintptr_t>(
+                    reinterpret_cast<fp_t>(&Secondary::f)));
+      }
+#endif
+      THEN("calling the target with the canonical this has the same effect") {
+        auto self = stop::GetCanonicalThisPointer(&secondary, &A::f);
+        REQUIRE(reinterpret_cast<void *>(self) ==
+                static_cast<void *>(&secondary));
+        REQUIRE(canonicalFP(self) == 13);
+      }
+    }
+    WHEN("the override needs no thunk") {
+      THEN("the canonical pointer is the vtable entry") {
+        REQUIRE(stop::GetCanonicalFunctionPointer(&plain, &A::f) ==
+                stop::GetFunctionPointer(&plain, &A::f));
+        REQUIRE(stop::GetCanonicalThisPointer(&plain, &A::f) ==
+                static_cast<A *>(&plain));
+      }
+    }
+  }
+  GIVEN("a secondary base more than 127 bytes into the object") {
+    class A {
+    public:
+      virtual ~A() {}
+      virtual int f() { return 1; }
+    };
+    class Big {
+    public:
+      virtual ~Big() {}
+      char pad_[300];
+    };
+    class D : public Big, public A {
+    public:
+      int f() override { return d_; }
+      int d_ = 7;
+    };
+    auto d = D{};
+    WHEN("the override is resolved") {
+      auto canonicalFP = stop::GetCanonicalFunctionPointer(&d, &A::f);
+      auto self = stop::GetCanonicalThisPointer(&d, &A::f);
+      THEN("the 32-bit adjustment is decoded") {
+        REQUIRE(reinterpret_cast<void *>(self) == static_cast<void *>(&d));
+        REQUIRE(canonicalFP(self) == 7);
+      }
+    }
+  }
+  GIVEN("an override of a virtual base's function") {
+    class B {
+    public:
+      virtual ~B() {}
+      virtual int f() { return 1; }
+      int b_ = 0;
+    };
+    class M : public virtual B {
+    public:
+      int f() override { return m_; }
+      int m_ = 5;
+    };
+    class D : public M {
+    public:
+      int d_ = 6;
+    };
+    auto m = M{};
+    auto d = D{};
+    WHEN("it is found through the virtual base's vtable") {
+      auto thunkFP = stop::GetFunctionPointer(&d, &B::f);
+      auto canonicalFP = stop::GetCanonicalFunctionPointer(&d, &B::f);
+      auto self = stop::GetCanonicalThisPointer(&d, &B::f);
+      THEN("the virtual thunk's vcall offset leads back to M") {
+        REQUIRE(thunkFP != canonicalFP);
+        REQUIRE(reinterpret_cast<void *>(self) ==
+                static_cast<void *>(static_cast<M *>(&d)));
+        REQUIRE(canonicalFP(self) == 5);
+      }
+      THEN("it is the same target whichever class holds the thunk") {
+        REQUIRE(canonicalFP == stop::GetCanonicalFunctionPointer(&m, &B::f));
+        REQUIRE(canonicalFP ==
+                reinterpret_cast<decltype(canonicalFP)>(
+                    stop::GetFunctionPointer(&m, &M::f)));
+      }
+    }
+  }
+}
+
+SCENARIO("unified_call_cast matches GCC's bound member function extension",
+         "[call-cast]") {
+  GIVEN("a hierarchy with const virtual and non-virtual member functions") {
+    class A {
+    public:
+      virtual int f(int x) const { return x + 1; }
+      int g(int x) const { return x + 2; }
+      virtual ~A() {}
+    };
+    class B : public A {
+    public:
+      int f(int x) const override { return x + 3; }
+    };
+    using fp_t = int (*)(const A *, int);
+    using memfun_t = int (A::*)(int) const;
+    WHEN("a virtual function is cast through an object") {
+      auto b = B{};
+      const A &a = b;
+      memfun_t mf = &A::f;
+      auto castFP = stop::unified_call_cast<fp_t>(a, mf);
+      THEN("it is what the extension gives, the final overrider") {
+        REQUIRE(castFP == (fp_t)(a.*mf));
+        REQUIRE(castFP(&a, 1) == 4);
+        REQUIRE(castFP == stop::unified_call_cast<fp_t>(&b, mf));
+      }
+      THEN("an object of the base gives the base's function") {
+        auto base = A{};
+        REQUIRE(stop::unified_call_cast<fp_t>(base, mf) == (fp_t)(base.*mf));
+        REQUIRE(stop::unified_call_cast<fp_t>(base, mf) != castFP);
+      }
+    }
+    WHEN("a non-virtual function is cast") {
+      auto b = B{};
+      memfun_t mf = &A::g;
+      THEN("the object is not needed") {
+        REQUIRE(stop::unified_call_cast<fp_t>(mf) == (fp_t)(&A::g));
+        REQUIRE(stop::unified_call_cast<fp_t>(b, mf) == (fp_t)(&A::g));
+        REQUIRE(stop::unified_call_cast<fp_t>(mf)(&b, 1) == 3);
+      }
+    }
+    WHEN("a virtual function is cast without an object") {
+      THEN("there is no function to give") {
+        REQUIRE(stop::unified_call_cast<fp_t>(&A::f) == nullptr);
+      }
+    }
+  }
+}
+
+SCENARIO("Qualified member functions can be extracted", "[pmf-qualifiers]") {
+  GIVEN("a hierarchy whose member functions are cv and ref qualified") {
+    class Q {
+    public:
+      virtual int c() const { return 1; }
+      virtual int v() volatile { return 2; }
+      virtual int cv() const volatile { return 3; }
+      virtual int l() & { return 4; }
+      virtual int r() && { return 5; }
+      virtual int cl() const & { return 6; }
+      int n() const { return 7; }
+      virtual ~Q() {}
+    };
+    class R : public Q {
+    public:
+      int c() const override { return 11; }
+      int r() && override { return 15; }
+    };
+    WHEN("they are extracted with an object") {
+      auto r = R{};
+      auto cFP = stop::GetFunctionPointer(&r, &Q::c);
+      auto vFP = stop::GetFunctionPointer(&r, &Q::v);
+      auto cvFP = stop::GetFunctionPointer(&r, &Q::cv);
+      auto lFP = stop::GetFunctionPointer(&r, &Q::l);
+      auto rFP = stop::GetFunctionPointer(&r, &Q::r);
+      auto clFP = stop::GetFunctionPointer(&r, &Q::cl);
+      THEN("this keeps the cv qualifiers and drops the ref qualifier") {
+        REQUIRE((std::is_same<decltype(cFP), int (*)(const Q *)>::value));
+        REQUIRE((std::is_same<decltype(vFP), int (*)(volatile Q *)>::value));
+        REQUIRE((std::is_same<decltype(cvFP),
+                              int (*)(const volatile Q *)>::value));
+        REQUIRE((std::is_same<decltype(lFP), int (*)(Q *)>::value));
+        REQUIRE((std::is_same<decltype(rFP), int (*)(Q *)>::value));
+        REQUIRE((std::is_same<decltype(clFP), int (*)(const Q *)>::value));
+      }
+      THEN("calling them reaches the final overriders") {
+        REQUIRE(cFP(&r) == 11);
+        REQUIRE(vFP(&r) == 2);
+        REQUIRE(cvFP(&r) == 3);
+        REQUIRE(lFP(&r) == 4);
+        REQUIRE(rFP(&r) == 15);
+        REQUIRE(clFP(&r) == 6);
+      }
+      THEN("a const object works with a const member function") {
+        const R &cr = r;
+        REQUIRE(stop::GetFunctionPointer(&cr, &Q::c) == cFP);
+        REQUIRE(stop::GetAdjustedThisPointer(&cr, &Q::c) == &cr);
+      }
+      THEN("the GCC extension agrees") {
+        REQUIRE(cFP == (decltype(cFP))(r.*(&Q::c)));
+      }
+    }
+    WHEN("they are extracted without an object") {
+      THEN("non-virtual ones are found directly") {
+        auto nFP = stop::GetFunctionPointer(&Q::n);
+        REQUIRE(nFP(nullptr) == 7);
+      }
+      THEN("virtual ones are resolved for the dynamic type") {
+        auto r = R{};
+        REQUIRE(stop::GetFunctionPointer<R>(&Q::c) ==
+                stop::GetFunctionPointer(&r, &Q::c));
+        REQUIRE(stop::GetFunctionPointer<R>(&Q::r) ==
+                stop::GetFunctionPointer(&r, &Q::r));
+      }
+    }
+  }
+#if defined(__cpp_noexcept_function_type)
+  GIVEN("a noexcept member function") {
+    class N {
+    public:
+      virtual int f() const noexcept { return 8; }
+      virtual ~N() {}
+    };
+    WHEN("it is extracted") {
+      auto n = N{};
+      auto fFP = stop::GetFunctionPointer(&n, &N::f);
+      THEN("it is found like any other") { REQUIRE(fFP(&n) == 8); }
+    }
+  }
+#endif
+}
+
+SCENARIO("A prepared slot probe finds an object's virtual function",
+         "[slot-probe]") {
+  GIVEN("entities where one type has a fast path") {
+    class Entity {
+    public:
+      virtual int update(int t) const { return t; }
+      virtual int type() const { return 0; }
+      virtual ~Entity() {}
+    };
+    class Fast : public Entity {
+    public:
+      int update(int t) const override { return t + 1; }
+    };
+    class Slow : public Entity {
+    public:
+      int update(int t) const override { return t + 2; }
+    };
+    using probe_t = stop::slot_probe<int (Entity::*)(int) const>;
+    auto fast = Fast{};
+    auto slow = Slow{};
+    auto vanilla = Entity{};
+    WHEN("a probe is prepared from a prototype of the fast type") {
+      auto probe = probe_t(&Entity::update, &fast);
+      THEN("it knows the slot") {
+        REQUIRE(probe.is_virtual());
+        REQUIRE(probe.slot() == 0);
+        REQUIRE(probe.adjustment() == 0);
+        REQUIRE(probe.target() == stop::GetFunctionPointer(&fast,
+                                                           &Entity::update));
+      }
+      THEN("only objects of the fast type match") {
+        REQUIRE(probe.matches(&fast));
+        REQUIRE_FALSE(probe.matches(&slow));
+        REQUIRE_FALSE(probe.matches(&vanilla));
+      }
+      THEN("the function it finds is the final overrider") {
+        REQUIRE(probe.function(&slow)(&slow, 1) == 3);
+        REQUIRE(probe.function(&slow) ==
+                stop::GetFunctionPointer(&slow, &Entity::update));
+      }
+    }
+    WHEN("a probe is prepared for a later slot") {
+      auto probe = stop::slot_probe<int (Entity::*)() const>(&Entity::type);
+      THEN("the slot is a byte offset into the vtable") {
+        REQUIRE(probe.slot() == static_cast<ptrdiff_t>(sizeof(void *)));
+        REQUIRE(probe.function(&fast) ==
+                stop::GetFunctionPointer(&fast, &Entity::type));
+      }
+    }
+  }
+  GIVEN("a function in a base that is not at offset 0") {
+    class Other {
+    public:
+      virtual int other() { return 0; }
+      virtual ~Other() {}
+    };
+    class Base {
+    public:
+      virtual int f() { return 1; }
+      virtual ~Base() {}
+    };
+    class Derived : public Other, public Base {
+    public:
+      int f() override { return 2; }
+    };
+    WHEN("a probe is prepared for the base's function") {
+      auto d = Derived{};
+      auto probe =
+          stop::slot_probe<int (Derived::*)()>(&Base::f, &d);
+      THEN("it reads the vtable of the base subobject") {
+        REQUIRE(probe.adjustment() == static_cast<ptrdiff_t>(sizeof(void *)));
+        REQUIRE(probe.matches(&d));
+        REQUIRE(probe.function(&d) ==
+                stop::GetFunctionPointer(
+                    &d, static_cast<int (Derived::*)()>(&Base::f)));
+      }
+    }
+  }
+  GIVEN("a non-virtual member function") {
+    class Entity {
+    public:
+      virtual int update(int t) const { return t; }
+      int id(int t) const { return t * 2; }
+      virtual ~Entity() {}
+    };
+    class Derived : public Entity {
+    public:
+      int update(int t) const override { return t + 1; }
+    };
+    using probe_t = stop::slot_probe<int (Entity::*)(int) const>;
+    auto entity = Entity{};
+    auto derived = Derived{};
+    WHEN("a probe is prepared for it") {
+      auto probe = probe_t(&Entity::id, &derived);
+      THEN("it is not virtual and has no slot") {
+        REQUIRE_FALSE(probe.is_virtual());
+        REQUIRE(probe.slot() == 0);
+      }
+      THEN("the function is the member itself, for every object") {
+        auto id = stop::GetFunctionPointer(&Entity::id);
+        REQUIRE(probe.target() == id);
+        REQUIRE(probe.function(&entity) == id);
+        REQUIRE(probe.function(&derived)(&derived, 2) == 4);
+        REQUIRE(probe.matches(&entity));
+        REQUIRE(probe.matches(&derived));
+      }
+    }
+    WHEN("a probe compares it against another function") {
+      auto probe = probe_t(&Entity::id,
+                           stop::GetFunctionPointer(&entity, &Entity::update));
+      THEN("no object matches, rather than slot 0 being read") {
+        REQUIRE_FALSE(probe.matches(&entity));
+        REQUIRE_FALSE(probe.matches(&derived));
+      }
+    }
+  }
+}
+
+SCENARIO("Slot probes run over arrays of objects", "[gather]") {
+  GIVEN("an array of entities, some of a type with a fast path") {
+    class Entity {
+    public:
+      virtual int update(int t) const { return t; }
+      int id(int t) const { return t; }
+      virtual ~Entity() {}
+    };
+    class Fast : public Entity {
+    public:
+      int update(int t) const override { return t + 1; }
+    };
+    class Slow : public Entity {
+    public:
+      int update(int t) const override { return t + 2; }
+    };
+    Fast fast[64];
+    Slow slow[64];
+    std::vector<const Entity *> entities;
+    for (int i = 0; i < 70; ++i) {
+      if (i % 3 == 0 || i % 7 == 0) {
+        entities.push_back(&slow[i % 64]);
+      } else {
+        entities.push_back(&fast[i % 64]);
+      }
+    }
+    auto probe = stop::slot_probe<int (Entity::*)(int) const>(&Entity::update,
+                                                               &fast[0]);
+    WHEN("a block of them is probed at once") {
+      auto mask = stop::ProbeSlots(probe, entities.data(), 37);
+      THEN("each bit says whether that entity matches") {
+        for (size_t i = 0; i < 64; ++i) {
+          auto bit = (mask >> i) & 1;
+          REQUIRE(bit == (i < 37 && probe.matches(entities[i]) ? 1u : 0u));
+        }
+      }
+    }
+    WHEN("they are partitioned") {
+      std::vector<uint32_t> indices(entities.size());
+      auto n = stop::PartitionSlowPath(probe, entities.data(), entities.size(),
+                                       indices.data());
+      THEN("exactly the entities that do not match are listed, in order") {
+        std::vector<uint32_t> expected;
+        for (size_t i = 0; i < entities.size(); ++i) {
+          if (!probe.matches(entities[i])) {
+            expected.push_back(static_cast<uint32_t>(i));
+          }
+        }
+        indices.resize(n);
+        REQUIRE(indices == expected);
+        REQUIRE(n == 30);
+      }
+    }
+    WHEN("the probe is for a non-virtual function") {
+      using probe_t = stop::slot_probe<int (Entity::*)(int) const>;
+      auto always = probe_t(&Entity::id, &fast[0]);
+      auto never = probe_t(&Entity::id, probe.target());
+      std::vector<uint32_t> indices(entities.size());
+      THEN("every object matches or none does") {
+        REQUIRE(stop::ProbeSlots(always, entities.data(), 37) ==
+                (uint64_t(1) << 37) - 1);
+        REQUIRE(stop::ProbeSlots(always, entities.data(), 64) == ~uint64_t(0));
+        REQUIRE(stop::ProbeSlots(never, entities.data(), 37) == 0);
+      }
+      THEN("the slow path is empty or everything") {
+        REQUIRE(stop::PartitionSlowPath(always, entities.data(),
+                                        entities.size(), indices.data()) == 0);
+        auto n = stop::PartitionSlowPath(never, entities.data(),
+                                         entities.size(), indices.data());
+        REQUIRE(n == entities.size());
+        REQUIRE(indices[0] == 0);
+        REQUIRE(indices[n - 1] == n - 1);
+      }
+    }
+  }
+}
+
+SCENARIO("fast_cast gives the same results as dynamic_cast", "[fast-cast]") {
+  GIVEN("a single inheritance hierarchy") {
+    class B {
+    public:
+      virtual ~B() {}
+    };
+    class D : public B {};
+    class E : public B {};
+    auto d = D{};
+    auto e = E{};
+    WHEN("a base pointer is cast down") {
+      B *pd = &d;
+      B *pe = &e;
+      THEN("it succeeds for the right type, and again from the cache") {
+        REQUIRE(stop::fast_cast<D *>(pd) == &d);
+        REQUIRE(stop::fast_cast<D *>(pd) == &d);
+      }
+      THEN("it fails for another type, and again from the cache") {
+        REQUIRE(stop::fast_cast<D *>(pe) == nullptr);
+        REQUIRE(stop::fast_cast<D *>(pe) == nullptr);
+        REQUIRE(stop::fast_cast<E *>(pe) == &e);
+      }
+      THEN("a null pointer stays null") {
+        REQUIRE(stop::fast_cast<D *>(static_cast<B *>(nullptr)) == nullptr);
+      }
+      THEN("const is kept") {
+        const B *cpd = pd;
+        REQUIRE(stop::fast_cast<const D *>(cpd) == &d);
+      }
+    }
+  }
+  GIVEN("a diamond hierarchy") {
+    class B {
+    public:
+      virtual ~B() {}
+      int b = 0;
+    };
+    class M1 : public B {};
+    class M2 : public B {};
+    class D : public M1, public M2 {};
+    auto d = D{};
+    auto m2 = M2{};
+    WHEN("one side is cast across to the other") {
+      M1 *p1 = &d;
+      THEN("the offset between the sides is applied") {
+        REQUIRE(stop::fast_cast<M2 *>(p1) == dynamic_cast<M2 *>(p1));
+        REQUIRE(stop::fast_cast<M2 *>(p1) == static_cast<M2 *>(&d));
+      }
+    }
+    WHEN("each base subobject is cast down") {
+      B *b1 = static_cast<M1 *>(&d);
+      B *b2 = static_cast<M2 *>(&d);
+      B *b3 = &m2;
+      THEN("each gets its own offset") {
+        REQUIRE(stop::fast_cast<D *>(b1) == &d);
+        REQUIRE(stop::fast_cast<D *>(b2) == &d);
+        REQUIRE(stop::fast_cast<D *>(b1) == &d);
+        REQUIRE(stop::fast_cast<D *>(b3) == nullptr);
+        REQUIRE(stop::fast_cast<M2 *>(b2) == static_cast<M2 *>(&d));
+        REQUIRE(stop::fast_cast<M2 *>(b1) == static_cast<M2 *>(&d));
+      }
+    }
+  }
+  GIVEN("a virtual base hierarchy") {
+    class B {
+    public:
+      virtual ~B() {}
+      int b = 0;
+    };
+    class M1 : public virtual B {
+    public:
+      int m1 = 1;
+    };
+    class M2 : public virtual B {
+    public:
+      int m2 = 2;
+    };
+    class D : public M1, public M2 {};
+    auto d = D{};
+    auto m1 = M1{};
+    WHEN("the virtual base is cast down") {
+      B *bd = &d;
+      B *bm = &m1;
+      THEN("the vbase offset is captured per dynamic type") {
+        REQUIRE(stop::fast_cast<M2 *>(bd) == static_cast<M2 *>(&d));
+        REQUIRE(stop::fast_cast<M2 *>(bd) == static_cast<M2 *>(&d));
+        REQUIRE(stop::fast_cast<M2 *>(bm) == nullptr);
+        REQUIRE(stop::fast_cast<M1 *>(bm) == &m1);
+        REQUIRE(stop::fast_cast<M1 *>(bd) == static_cast<M1 *>(&d));
+      }
+    }
+  }
+}
+
+SCENARIO("Type information is read from the vtable", "[typeid]") {
+  GIVEN("a hierarchy with multiple inheritance") {
+    class A {
+    public:
+      virtual ~A() {}
+      int a = 0;
+    };
+    class B {
+    public:
+      virtual ~B() {}
+      int b = 0;
+    };
+    class C : public A, public B {};
+    auto a = A{};
+    auto c = C{};
+    WHEN("the type_info is read through any subobject") {
+      A *ca = &c;
+      B *cb = &c;
+      THEN("it is typeid of the complete object") {
+        REQUIRE(stop::GetTypeInfo(&a) == typeid(A));
+        REQUIRE(stop::GetTypeInfo(ca) == typeid(C));
+        REQUIRE(stop::GetTypeInfo(cb) == typeid(C));
+        REQUIRE(&stop::GetTypeInfo(cb) == &typeid(*cb));
+      }
+    }
+    WHEN("type keys are taken") {
+      stop::type_identity identity;
+      auto ka = identity.key(&a);
+      auto kc = identity.key(static_cast<B *>(&c));
+      THEN("they agree with typeid and with each other") {
+        REQUIRE(ka.hash == typeid(A).hash_code());
+        REQUIRE(kc.hash == typeid(C).hash_code());
+        REQUIRE(identity.key(static_cast<A *>(&c)) == kc);
+        REQUIRE(ka != kc);
+      }
+      THEN("they work as map keys") {
+        std::unordered_map<stop::type_key, int, stop::type_key::hasher> count;
+        count[ka]++;
+        count[kc]++;
+        count[identity.key(static_cast<A *>(&c))]++;
+        REQUIRE(count.size() == 2);
+        REQUIRE(count[kc] == 2);
+      }
+    }
+  }
+}
+
+// Two distinct functions with identical code: linking with --icf=all folds
+// them into one address.
+int icf_twin_a(int x) { return x * 3 + 1; }
+int icf_twin_b(int x) { return x * 3 + 1; }
+int icf_single(int x) { return x * 5 + 2; }
+
+SCENARIO("Fast-path keys are checked for folded functions", "[icf]") {
+  // collisions here are expected, so they are not reported
+  GIVEN("a registry of fast-path keys that refuses collisions") {
+    stop::icf::fast_path_keys keys(stop::icf::policy::refuse, nullptr);
+    WHEN("a function that was not folded is registered") {
+      THEN("it is accepted") {
+        REQUIRE(stop::icf::FunctionsAt(reinterpret_cast<uintptr_t>(
+                                           &icf_single)).size() == 1);
+        REQUIRE(keys.add(&icf_single, "icf_single"));
+        REQUIRE(keys.contains(reinterpret_cast<const void *>(&icf_single)));
+      }
+    }
+    WHEN("one of two identical functions is registered") {
+      auto folded = reinterpret_cast<uintptr_t>(&icf_twin_a) ==
+                    reinterpret_cast<uintptr_t>(&icf_twin_b);
+      auto registered = keys.add(&icf_twin_a, "icf_twin_a");
+      THEN("it is refused exactly when the linker folded them") {
+        REQUIRE(registered == !folded);
+        REQUIRE(stop::icf::FunctionsAt(reinterpret_cast<uintptr_t>(
+                                           &icf_twin_a)).size() ==
+                (folded ? 2u : 1u));
+      }
+    }
+    WHEN("the same address is registered under two names") {
+      keys.add(&icf_single, "icf_single");
+      THEN("the second registration is refused") {
+        REQUIRE_FALSE(keys.add(&icf_single, "another key"));
+        REQUIRE(keys.size() == 1);
+      }
+    }
+  }
+  GIVEN("a registry of fast-path keys that only warns") {
+    stop::icf::fast_path_keys keys(stop::icf::policy::warn, nullptr);
+    WHEN("a colliding key is registered") {
+      keys.add(&icf_single, "icf_single");
+      THEN("it is still registered") {
+        REQUIRE(keys.add(&icf_single, "another key"));
+        REQUIRE(keys.size() == 2);
+      }
+    }
+  }
+  GIVEN("a registry that reports to a file") {
+    auto *report = std::tmpfile();
+    REQUIRE(report);
+    stop::icf::fast_path_keys keys(stop::icf::policy::refuse, report);
+    WHEN("a colliding key is refused") {
+      keys.add(&icf_single, "icf_single");
+      keys.add(&icf_single, "another key");
+      THEN("the report names both keys") {
+        std::rewind(report);
+        std::string text;
+        char buffer[256];
+        while (std::fgets(buffer, sizeof(buffer), report)) {
+          text += buffer;
+        }
+        REQUIRE(text.find("error: fast-path key another key") == 0);
+        REQUIRE(text.find("fast-path key icf_single") != std::string::npos);
+      }
+    }
+    std::fclose(report);
+  }
+}
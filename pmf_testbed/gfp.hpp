@@ -1,11 +1,25 @@
 #pragma once
 
+#include "elf.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cxxabi.h>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 namespace stop {
 
 /* Call this as the first thing in a function to get the address of its
  * address
  */
-auto GetCurrentFunctionAddr(int8_t magic) -> uintptr_t {
+__attribute__((noinline)) inline auto GetCurrentFunctionAddr(int8_t magic) -> uintptr_t {
   // GCC/Clang magic
   // https://gcc.gnu.org/onlinedocs/gcc/Return-Address.html
   // Note that inlining/optimisation will defeat this.
@@ -15,7 +29,7 @@ auto GetCurrentFunctionAddr(int8_t magic) -> uintptr_t {
 
 namespace inthenameoflove {
 
-auto get_offset_to_top(void *object) -> ptrdiff_t {
+inline auto get_offset_to_top(void *object) -> ptrdiff_t {
   // vtable pointer points to the first virtual method, but immediately
   // preceeding that are RTTI pointer (-1) and offset-to-top (-2)
   // https://mentorembedded.github.io/cxx-abi/abi.html#vtable-construction
@@ -23,92 +37,561 @@ auto get_offset_to_top(void *object) -> ptrdiff_t {
   return (*vtablep)[-2];
 }
 
-auto get_vtable_entry(void *object, ptrdiff_t index) -> uintptr_t {
+// Before offset-to-top come the vcall and vbase offsets, at negative byte
+// offsets from the address point. A virtual base's position in the complete
+// object is read from here, as is a virtual thunk's this-adjustment.
+inline auto get_vtable_prefix(void *object, ptrdiff_t byte_offset) -> ptrdiff_t {
+  auto vtable = *reinterpret_cast<char **>(object);
+  return *reinterpret_cast<ptrdiff_t *>(vtable + byte_offset);
+}
+
+// The most derived object containing object, like dynamic_cast<void *>.
+inline auto get_complete_object(void *object) -> void * {
+  return static_cast<char *>(object) + get_offset_to_top(object);
+}
+
+inline auto get_vtable_entry(void *object, ptrdiff_t index) -> uintptr_t {
   auto vtablep = reinterpret_cast<uintptr_t **>(object);
   return (*vtablep)[index];
 }
 
-template <typename> struct pmf;
+// What an Itanium this-adjusting thunk does before jumping to its target:
+// add offset to this, then (for a virtual thunk) add the vcall offset found
+// at byte vcall of the vtable this now points to.
+struct thunk_t {
+  uintptr_t target; // the code jumped to; the entry itself if not a thunk
+  ptrdiff_t offset;
+  ptrdiff_t vcall; // 0 when there is no virtual adjustment
+  bool decoded;
 
-template <class R, typename C, typename... Args> struct pmf<R (C::*)(Args...)> {
-  using funcptr_t = R (*)(C *, Args...);
+  auto apply(void *self) const -> void * {
+    auto p = static_cast<char *>(self) + offset;
+    return vcall ? p + get_vtable_prefix(p, vcall) : p;
+  }
+};
+
+// Recognise the x86-64 thunks GCC and Clang emit:
+//   [endbr64]
+//   [sub/add $imm8/imm32, %rdi]                  fixed adjustment
+//   [mov (%rdi), %r10; add disp8/32(%r10), %rdi] virtual adjustment (GCC)
+//   [mov (%rdi), %rax; add disp8/32(%rax), %rdi] virtual adjustment (Clang)
+//   jmp rel8/rel32
+// with at least one adjustment. Anything else, including a thunk an optimiser
+// merged with its target's body, is returned as not a thunk.
+inline auto decode_thunk(uintptr_t code) -> thunk_t {
+  thunk_t thunk = {code, 0, 0, false};
+#if defined(__x86_64__)
+  auto *p = reinterpret_cast<const unsigned char *>(code);
+  auto imm32 = [](const unsigned char *at) {
+    int32_t value;
+    std::memcpy(&value, at, sizeof(value));
+    return static_cast<ptrdiff_t>(value);
+  };
+  auto imm8 = [](const unsigned char *at) {
+    return static_cast<ptrdiff_t>(static_cast<int8_t>(*at));
+  };
+  if (p[0] == 0xf3 && p[1] == 0x0f && p[2] == 0x1e && p[3] == 0xfa) {
+    p += 4; // endbr64
+  }
+  bool adjusts = false;
+  ptrdiff_t offset = 0;
+  if (p[0] == 0x48 && (p[1] == 0x83 || p[1] == 0x81) &&
+      (p[2] == 0xef || p[2] == 0xc7)) {
+    // 48 83 /5 ib: sub imm8; 48 81 /5 id: sub imm32; /0 is add
+    auto wide = p[1] == 0x81;
+    auto value = wide ? imm32(p + 3) : imm8(p + 3);
+    offset = p[2] == 0xef ? -value : value;
+    p += wide ? 7 : 4;
+    adjusts = true;
+  }
+  ptrdiff_t vcall = 0;
+  auto r10 = p[0] == 0x4c && p[1] == 0x8b && p[2] == 0x17 && p[3] == 0x49 &&
+             p[4] == 0x03 && (p[5] == 0x7a || p[5] == 0xba);
+  auto rax = p[0] == 0x48 && p[1] == 0x8b && p[2] == 0x07 && p[3] == 0x48 &&
+             p[4] == 0x03 && (p[5] == 0x78 || p[5] == 0xb8);
+  if (r10 || rax) {
+    // mov (%rdi),%r10; add disp(%r10),%rdi, or the same through %rax
+    auto wide = p[5] == 0xba || p[5] == 0xb8;
+    vcall = wide ? imm32(p + 6) : imm8(p + 6);
+    p += wide ? 10 : 7;
+    adjusts = true;
+  }
+  if (!adjusts) {
+    return thunk;
+  }
+  uintptr_t target;
+  if (p[0] == 0xe9) {
+    target = reinterpret_cast<uintptr_t>(p + 5) + imm32(p + 1);
+  } else if (p[0] == 0xeb) {
+    target = reinterpret_cast<uintptr_t>(p + 2) + imm8(p + 1);
+  } else {
+    return thunk;
+  }
+  thunk = {target, offset, vcall, true};
+#endif
+  return thunk;
+}
+
+// The address of an object whatever its cv qualifiers, for reading its
+// vtable.
+inline auto object_address(const volatile void *object) -> void * {
+  return const_cast<void *>(object);
+}
+
+// An Itanium member function pointer to a member of C whose this is a T*:
+// T is C with the member function's cv qualifiers.
+template <class R, typename T, typename... Args> struct pmf_layout {
+  using class_type = typename std::remove_cv<T>::type;
+  using this_t = T *;
+  using funcptr_t = R (*)(T *, Args...);
 
   // https://mentorembedded.github.io/cxx-abi/abi.html#member-pointers
   union {
     funcptr_t ptr;
     ptrdiff_t vtoff;
   };
-  // TODO: I'm not clear on the use of this.
+  // Bytes to add to a C* before the call. Non-zero when the pointer was
+  // converted from a member of a base that is not at offset 0 in C; for a
+  // virtual function, the vtable is also read from that subobject.
   ptrdiff_t adj;
 
   auto is_virtual() const -> bool {
     return (vtoff % 2) == 1;
   };
+  // Byte offset of the function's slot in the vtable
   auto vtoffset() const -> ptrdiff_t {
     return vtoff - 1;
   };
+  auto vtindex() const -> ptrdiff_t {
+    return vtoffset() / static_cast<ptrdiff_t>(sizeof(uintptr_t));
+  };
 
-  auto devirtualise(C *obj) const -> funcptr_t {
-    return reinterpret_cast<funcptr_t>(get_vtable_entry(obj, vtoffset()));
+  auto devirtualise(T *obj) const -> funcptr_t {
+    return reinterpret_cast<funcptr_t>(
+        get_vtable_entry(object_address(shiftthis(obj)), vtindex()));
   }
 
-  auto shiftthis(C *obj) const -> C *{
-    return reinterpret_cast<C *>(reinterpret_cast<uintptr_t>(obj) +
-                                 get_offset_to_top(obj));
+  auto shiftthis(T *obj) const -> T *{
+    return reinterpret_cast<T *>(reinterpret_cast<uintptr_t>(obj) + adj);
   }
 
   // TODO: nullptr is "I have no idea how to get this..."
   auto getptr() const -> funcptr_t { return is_virtual() ? nullptr : ptr; }
 
-  auto getptr(C *obj) const -> funcptr_t {
+  auto getptr(T *obj) const -> funcptr_t {
     return is_virtual() ? devirtualise(obj) : ptr;
   }
 
-  auto getthis(C *obj) const -> C *{
-    return is_virtual() ? shiftthis(obj) : obj;
+  // The this the function expects. A virtual function gets the subobject
+  // whose vtable it came from; if that slot is a thunk, the thunk adjusts
+  // further to the final overrider.
+  auto getthis(T *obj) const -> T *{ return shiftthis(obj); }
+
+  // Like getptr, but looking through a this-adjusting thunk: returns the
+  // function the thunk jumps to and leaves the thunk's adjustment in thunk,
+  // so the direct call is target(thunk.apply(getthis(obj)), ...). Two vtable
+  // entries that reach the same function this way compare equal.
+  auto getcanonical(T *obj, thunk_t &thunk) const -> funcptr_t {
+    thunk = decode_thunk(reinterpret_cast<uintptr_t>(getptr(obj)));
+    return reinterpret_cast<funcptr_t>(thunk.target);
   }
 };
+
+// Every qualifier combination has the same layout; only the type of this
+// differs. Ref qualifiers and noexcept do not change it.
+template <typename> struct pmf;
+
+#define STOP_PMF(QUALIFIERS, CV)                                              \
+  template <class R, typename C, typename... Args>                            \
+  struct pmf<R (C::*)(Args...) QUALIFIERS> : pmf_layout<R, CV C, Args...> {};
+#define STOP_PMF_CV(REF, NOEXCEPT)                                            \
+  STOP_PMF(REF NOEXCEPT, )                                                    \
+  STOP_PMF(const REF NOEXCEPT, const)                                         \
+  STOP_PMF(volatile REF NOEXCEPT, volatile)                                   \
+  STOP_PMF(const volatile REF NOEXCEPT, const volatile)
+#define STOP_PMF_REF(NOEXCEPT)                                                \
+  STOP_PMF_CV(, NOEXCEPT)                                                     \
+  STOP_PMF_CV(&, NOEXCEPT)                                                    \
+  STOP_PMF_CV(&&, NOEXCEPT)
+
+STOP_PMF_REF()
+#if defined(__cpp_noexcept_function_type)
+// C++17 made noexcept part of the function type
+STOP_PMF_REF(noexcept)
+#endif
+
+#undef STOP_PMF_REF
+#undef STOP_PMF_CV
+#undef STOP_PMF
+
+// A prototype object registered for D, used to resolve virtual functions
+// for D without being handed an object.
+template <class D> struct prototype_registry { static const D *object; };
+template <class D> const D *prototype_registry<D>::object = nullptr;
+
+// Whether C is a base of D that the compiler can locate without an object,
+// i.e. C is D or a non-virtual base. Converting a pointer to a member of C
+// into one of D is ill-formed exactly when C is a virtual base.
+template <class C, class D, class = void>
+struct is_static_base_of : std::false_type {};
+template <class C, class D>
+struct is_static_base_of<
+    C, D, decltype(static_cast<void (D::*)()>(std::declval<void (C::*)()>()),
+                   void())> : std::true_type {};
+
+// Offset of the C subobject in a D, worked out like offsetof: by converting
+// a pointer to uninitialised storage, which needs no object.
+template <class C, class D> auto base_offset() -> ptrdiff_t {
+  typename std::aligned_storage<sizeof(D), alignof(D)>::type storage;
+  auto *d = reinterpret_cast<D *>(&storage);
+  return reinterpret_cast<char *>(static_cast<C *>(d)) -
+         reinterpret_cast<char *>(d);
+}
+
+// Where D's vtables are, found from D's _ZTV symbol without an object.
+struct vtable_group {
+  const uintptr_t *first; // start of the _ZTV symbol
+  const uintptr_t *last;  // its end
+  uintptr_t rtti;
+
+  // The address point of the vtable used by the subobject offset bytes into
+  // a D; each one is preceded by its offset-to-top and the RTTI pointer.
+  auto address_point(ptrdiff_t offset) const -> const uintptr_t * {
+    for (auto *p = first; p + 2 <= last; ++p) {
+      if (p[1] == rtti && static_cast<ptrdiff_t>(p[0]) == -offset) {
+        return p + 2;
+      }
+    }
+    return nullptr;
+  }
+};
+
+template <class D> auto get_vtable_group() -> const vtable_group & {
+  static const vtable_group group = [] {
+    vtable_group g = {nullptr, nullptr,
+                      reinterpret_cast<uintptr_t>(&typeid(D))};
+    elf::symbol symbol;
+    if (elf::FindSymbolByName(std::string("_ZTV") + typeid(D).name(),
+                              symbol)) {
+      g.first = reinterpret_cast<const uintptr_t *>(symbol.address);
+      g.last = reinterpret_cast<const uintptr_t *>(symbol.address + symbol.size);
+    }
+    return g;
+  }();
+  return group;
+}
+
+// The final overrider D has for C's virtual function fp, from a registered
+// prototype or from D's vtable symbol. nullptr when neither is available,
+// when C is a virtual base of D, or when the function is pure in D.
+// Note an optimising build may not emit the vtable of a type that is never
+// the most derived type of an object, such as an abstract base.
+template <class D, class P>
+auto resolve_virtual(const P &fp, std::true_type) -> typename P::funcptr_t {
+  using C = typename P::class_type;
+  using funcptr_t = typename P::funcptr_t;
+  if (auto *prototype = prototype_registry<D>::object) {
+    return fp.getptr(
+        static_cast<typename P::this_t>(const_cast<D *>(prototype)));
+  }
+  auto &group = get_vtable_group<D>();
+  if (!group.first) {
+    return nullptr;
+  }
+  auto *table = group.address_point(base_offset<C, D>() + fp.adj);
+  if (!table) {
+    return nullptr;
+  }
+  auto entry = table[fp.vtindex()];
+  if (entry == reinterpret_cast<uintptr_t>(&__cxxabiv1::__cxa_pure_virtual)) {
+    return nullptr;
+  }
+  return reinterpret_cast<funcptr_t>(entry);
+}
+
+template <class D, class P>
+auto resolve_virtual(const P &fp, std::false_type) -> typename P::funcptr_t {
+  // only an object knows where a virtual base is
+  if (auto *prototype = prototype_registry<D>::object) {
+    return fp.getptr(
+        static_cast<typename P::this_t>(const_cast<D *>(prototype)));
+  }
+  return nullptr;
+}
 };
 
+// Register an object whose dynamic type is D, to resolve D's virtual
+// functions from when no object is at hand. It must outlive those lookups.
+// Unregistered types are looked up through their _ZTV symbol instead.
+template <class D> void RegisterPrototype(const D *prototype) {
+  inthenameoflove::prototype_registry<D>::object = prototype;
+}
+
 // Itanium ABI
 template <typename... Args> using pmf = inthenameoflove::pmf<Args...>;
 
+// pmf::getptr(obj) decides virtual or not and works out the slot for every
+// object. A slot_probe does that once for a virtual function, leaving a vptr
+// load, a slot load and (for matches) a compare per object: the test a loop
+// needs to skip the objects a fast path already handles.
+// A non-virtual function is the same for every object, so has no slot to
+// probe: function() returns it without reading the object.
+template <typename> class slot_probe;
+
+template <class C, class F> class slot_probe<F C::*> {
+  using pmf_t = pmf<F C::*>;
+
+public:
+  using this_t = typename pmf_t::this_t;
+  using funcptr_t = typename pmf_t::funcptr_t;
+
+  // target is what matches compares against, typically the function of the
+  // type with a fast path.
+  explicit slot_probe(F C::*fp, funcptr_t target = nullptr)
+      : target_(target) {
+    auto *pPMF = reinterpret_cast<const pmf_t *>(&fp);
+    virtual_ = pPMF->is_virtual();
+    adj_ = pPMF->adj;
+    slot_ = virtual_ ? pPMF->vtoffset() : 0;
+    direct_ = virtual_ ? nullptr : pPMF->ptr;
+  }
+
+  // Take the target from an object whose dynamic type provides it.
+  template <class D>
+  slot_probe(F C::*fp, D *prototype) : slot_probe(fp) {
+    target_ = function(static_cast<this_t>(prototype));
+  }
+
+  auto is_virtual() const -> bool { return virtual_; }
+  // Byte offset of the slot in the vtable, and of the subobject whose vtable
+  // it is.
+  auto slot() const -> ptrdiff_t { return slot_; }
+  auto adjustment() const -> ptrdiff_t { return adj_; }
+  auto target() const -> funcptr_t { return target_; }
+
+  auto function(this_t obj) const -> funcptr_t {
+    if (!virtual_) {
+      return direct_;
+    }
+    auto *subobject =
+        static_cast<char *>(inthenameoflove::object_address(obj)) + adj_;
+    auto *vtable = *reinterpret_cast<const char *const *>(subobject);
+    return *reinterpret_cast<const funcptr_t *>(vtable + slot_);
+  }
+
+  auto matches(this_t obj) const -> bool { return function(obj) == target_; }
+
+private:
+  funcptr_t target_;
+  funcptr_t direct_; // the function, when it is not virtual
+  ptrdiff_t adj_;
+  ptrdiff_t slot_;
+  bool virtual_;
+};
+
+namespace inthenameoflove {
+
+#if defined(__AVX2__)
+// Four slot probes at once: gather the vptrs of objects[0..4) + adj, gather
+// the slots at byte slot of those vtables, compare with target. Bit i of the
+// result is set when objects[i] matches. The addresses are gathered from as
+// indices off a null base.
+inline auto probe4(const void *const *objects, ptrdiff_t adj, ptrdiff_t slot,
+                   uintptr_t target) -> unsigned {
+  auto *none = static_cast<const long long *>(nullptr);
+  auto pointers =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(objects));
+  auto vptrs = _mm256_i64gather_epi64(
+      none, _mm256_add_epi64(pointers, _mm256_set1_epi64x(adj)), 1);
+  auto slots = _mm256_i64gather_epi64(
+      none, _mm256_add_epi64(vptrs, _mm256_set1_epi64x(slot)), 1);
+  auto equal = _mm256_cmpeq_epi64(
+      slots, _mm256_set1_epi64x(static_cast<long long>(target)));
+  return static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(equal)));
+}
+#endif
+
+#if defined(__AVX512F__) && defined(__AVX512VL__)
+// probe4 for eight objects
+inline auto probe8(const void *const *objects, ptrdiff_t adj, ptrdiff_t slot,
+                   uintptr_t target) -> unsigned {
+  auto pointers = _mm512_loadu_si512(objects);
+  auto vptrs = _mm512_i64gather_epi64(
+      _mm512_add_epi64(pointers, _mm512_set1_epi64(adj)), nullptr, 1);
+  auto slots = _mm512_i64gather_epi64(
+      _mm512_add_epi64(vptrs, _mm512_set1_epi64(slot)), nullptr, 1);
+  return _mm512_cmpeq_epi64_mask(
+      slots, _mm512_set1_epi64(static_cast<long long>(target)));
+}
+#endif
+};
+
+// Probe objects[0..count), count at most 64, against probe's target: bit i
+// of the result is set when objects[i] matches. Eight objects at a time with
+// AVX-512, four with AVX2, one at a time otherwise. A non-virtual probe
+// matches every object or none.
+template <class P>
+auto ProbeSlots(const slot_probe<P> &probe,
+                typename slot_probe<P>::this_t const *objects, size_t count)
+    -> uint64_t {
+  if (!probe.is_virtual()) {
+    auto all = count < 64 ? (uint64_t(1) << count) - 1 : ~uint64_t(0);
+    return probe.matches(nullptr) ? all : 0;
+  }
+  uint64_t mask = 0;
+  size_t i = 0;
+#if defined(__AVX2__)
+  auto *pointers = reinterpret_cast<const void *const *>(objects);
+  auto target = reinterpret_cast<uintptr_t>(probe.target());
+#endif
+#if defined(__AVX512F__) && defined(__AVX512VL__)
+  for (; i + 8 <= count; i += 8) {
+    mask |= uint64_t(inthenameoflove::probe8(pointers + i, probe.adjustment(),
+                                             probe.slot(), target))
+            << i;
+  }
+#elif defined(__AVX2__)
+  for (; i + 4 <= count; i += 4) {
+    mask |= uint64_t(inthenameoflove::probe4(pointers + i, probe.adjustment(),
+                                             probe.slot(), target))
+            << i;
+  }
+#endif
+  for (; i < count; ++i) {
+    if (probe.matches(objects[i])) {
+      mask |= uint64_t(1) << i;
+    }
+  }
+  return mask;
+}
+
+// Write the indices of the objects in [0, count) that do not match probe to
+// slow, in order, and return how many there are. slow needs room for count
+// indices. A loop over slow then makes the virtual calls with no skip test.
+// The non-matching lanes are packed with vpcompressd under AVX-512, and with
+// a table of lane positions under AVX2. A non-virtual probe sends every
+// object or none to slow.
+template <class P>
+auto PartitionSlowPath(const slot_probe<P> &probe,
+                       typename slot_probe<P>::this_t const *objects,
+                       size_t count, uint32_t *slow) -> size_t {
+  size_t n = 0;
+  size_t i = 0;
+  if (!probe.is_virtual()) {
+    // the same answer for every object
+    if (!probe.matches(nullptr)) {
+      for (; n < count; ++n) {
+        slow[n] = static_cast<uint32_t>(n);
+      }
+    }
+    return n;
+  }
+#if defined(__AVX2__)
+  auto *pointers = reinterpret_cast<const void *const *>(objects);
+  auto target = reinterpret_cast<uintptr_t>(probe.target());
+#endif
+#if defined(__AVX512F__) && defined(__AVX512VL__)
+  const auto lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  for (; i + 8 <= count; i += 8) {
+    auto miss = static_cast<__mmask8>(~inthenameoflove::probe8(
+        pointers + i, probe.adjustment(), probe.slot(), target));
+    auto index = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(i)), lanes);
+    _mm256_mask_compressstoreu_epi32(slow + n, miss, index);
+    n += __builtin_popcount(miss);
+  }
+#elif defined(__AVX2__)
+  // the set lanes of each 4-bit mask, packed to the front
+  alignas(16) static const uint32_t packed[16][4] = {
+      {0, 0, 0, 0}, {0, 0, 0, 0}, {1, 0, 0, 0}, {0, 1, 0, 0},
+      {2, 0, 0, 0}, {0, 2, 0, 0}, {1, 2, 0, 0}, {0, 1, 2, 0},
+      {3, 0, 0, 0}, {0, 3, 0, 0}, {1, 3, 0, 0}, {0, 1, 3, 0},
+      {2, 3, 0, 0}, {0, 2, 3, 0}, {1, 2, 3, 0}, {0, 1, 2, 3}};
+  for (; i + 4 <= count; i += 4) {
+    auto miss = ~inthenameoflove::probe4(pointers + i, probe.adjustment(),
+                                         probe.slot(), target) &
+                0xfu;
+    // writes four indices but only keeps the misses; n <= i, so it stays
+    // inside the first count
+    auto index = _mm_add_epi32(
+        _mm_set1_epi32(static_cast<int>(i)),
+        _mm_load_si128(reinterpret_cast<const __m128i *>(packed[miss])));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(slow + n), index);
+    n += __builtin_popcount(miss);
+  }
+#endif
+  for (; i < count; ++i) {
+    if (!probe.matches(objects[i])) {
+      slow[n++] = static_cast<uint32_t>(i);
+    }
+  }
+  return n;
+}
+
 // Return a non-member function taking a C* and Args, equivalent to calling C’s
-// member function with Args
-template <class C, typename R, typename... Args>
-auto GetFunctionPointer(R (C::*fp)(Args...)) -> R (*)(C *, Args...) {
-  using pmf_t = pmf<decltype(fp)>;
+// member function with Args on an object whose dynamic type is D (by default
+// C itself). Virtual functions are resolved without an object, see
+// inthenameoflove::resolve_virtual. A cv-qualified member function gives a
+// function taking a cv-qualified C*.
+template <class D = void, class C, class F>
+auto GetFunctionPointer(F C::*fp) -> typename pmf<F C::*>::funcptr_t {
+  using pmf_t = pmf<F C::*>;
+  using dynamic_t = typename std::conditional<std::is_void<D>::value, C, D>::type;
 
   auto *pPMF = reinterpret_cast<pmf_t *>(&fp);
-  return pPMF->getptr();
+  if (!pPMF->is_virtual()) {
+    return pPMF->getptr();
+  }
+  return inthenameoflove::resolve_virtual<dynamic_t>(
+      *pPMF, inthenameoflove::is_static_base_of<C, dynamic_t>());
 }
 
 // Return a non-member function taking a C* and Args, equivalent to calling C’s
 // member function with Args
-template <class C, class D, typename R, typename... Args>
-auto GetFunctionPointer(D *obj, R (C::*fp)(Args...)) -> R (*)(C *, Args...) {
-  using pmf_t = pmf<decltype(fp)>;
+template <class C, class D, class F>
+auto GetFunctionPointer(D *obj, F C::*fp) -> typename pmf<F C::*>::funcptr_t {
+  using pmf_t = pmf<F C::*>;
 
   auto *pPMF = reinterpret_cast<pmf_t *>(&fp);
-  return pPMF->getptr(static_cast<C *>(obj));
+  return pPMF->getptr(static_cast<typename pmf_t::this_t>(obj));
 }
 
-/*
-// Return the C* that would be used if C’s member pointer was called on a D*.
-template <class C, class D, typename R, typename... Args>
-auto GetAdjustedThisPointer(D *obj, R (C::*fp)(Args...)) -> C *{
-  using pmf_t = pmf<decltype(fp)>;
+// As GetFunctionPointer, but a this-adjusting thunk is resolved to the
+// function it jumps to. The result must be called with
+// GetCanonicalThisPointer, and compares equal however the vtable reached it.
+template <class C, class D, class F>
+auto GetCanonicalFunctionPointer(D *obj, F C::*fp)
+    -> typename pmf<F C::*>::funcptr_t {
+  using pmf_t = pmf<F C::*>;
 
   auto *pPMF = reinterpret_cast<pmf_t *>(&fp);
-  return pPMF->getthis(obj);
+  inthenameoflove::thunk_t thunk;
+  return pPMF->getcanonical(static_cast<typename pmf_t::this_t>(obj), thunk);
 }
-*/
+
+// The this GetCanonicalFunctionPointer's result expects: the adjusted this,
+// moved on by whatever the skipped thunk would have done.
+template <class C, class D, class F>
+auto GetCanonicalThisPointer(D *obj, F C::*fp) -> typename pmf<F C::*>::this_t {
+  using pmf_t = pmf<F C::*>;
+  using this_t = typename pmf_t::this_t;
+
+  auto *pPMF = reinterpret_cast<pmf_t *>(&fp);
+  auto *self = pPMF->getthis(static_cast<this_t>(obj));
+  inthenameoflove::thunk_t thunk;
+  pPMF->getcanonical(static_cast<this_t>(obj), thunk);
+  return static_cast<this_t>(
+      thunk.apply(inthenameoflove::object_address(self)));
+}
+
 // Return the C* that would be used if C’s member pointer was called on a D*.
-template <class C, class D, typename R, typename... Args>
-auto GetAdjustedThisPointer(D *obj, R (C::*fp)(Args...)) -> C *{
-  // TODO: Only allow this for upcasts, rather than relying on SFINAE.
-  // This seems simple... Probably complex in the virtual-base case,
-  // more like the above version.
-  return obj;
+// The upcast to C finds C in D, reading the vbase offset from the vtable
+// prefix if C is a virtual base; the pmf's adj then moves to the subobject
+// the function (or, for a virtual function, its vtable slot) expects.
+template <class C, class D, class F>
+auto GetAdjustedThisPointer(D *obj, F C::*fp) -> typename pmf<F C::*>::this_t {
+  using pmf_t = pmf<F C::*>;
+
+  auto *pPMF = reinterpret_cast<pmf_t *>(&fp);
+  return pPMF->getthis(static_cast<typename pmf_t::this_t>(obj));
 }
 };
@@ -0,0 +1,176 @@
+// g++ hiergen.cpp -O2 -std=c++11 -Wall -o hiergen
+// ./hiergen depth fanout secondary virtual-ratio [seed] > dispatch_gen.cpp
+//
+// Writes a random class hierarchy, and a main that runs dispatch.hpp's
+// check over every (class, unambiguous base) pair of it.
+//   depth      levels of classes
+//   fanout     roots, and classes derived from each class of the level above
+//              (at most 12 classes per level)
+//   secondary  further bases per class, picked from any earlier level
+//   virtual    the chance that each base is inherited virtually
+// Every class overrides f, so each has a unique final overrider, and adds a
+// virtual function of its own, so f is not always in the first slot. f reads
+// a member so that this matters, and is not inlined: GCC would otherwise
+// copy such a small body into each thunk, leaving no thunk to measure.
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <set>
+#include <vector>
+
+namespace {
+
+const size_t max_per_level = 12;
+
+struct base_t {
+  int id;
+  bool is_virtual;
+};
+
+struct class_t {
+  std::vector<base_t> bases;
+  std::set<int> closure; // every direct and indirect base
+};
+
+std::vector<class_t> classes;
+
+// Subobjects of each base in the non-virtual part of c: c itself and its
+// non-virtual bases, recursively.
+void non_virtual_part(int c, std::map<int, int> &count) {
+  ++count[c];
+  for (auto &b : classes[c].bases) {
+    if (!b.is_virtual) {
+      non_virtual_part(b.id, count);
+    }
+  }
+}
+
+void virtual_bases(int c, std::set<int> &found) {
+  for (auto &b : classes[c].bases) {
+    if (b.is_virtual) {
+      found.insert(b.id);
+    }
+    virtual_bases(b.id, found);
+  }
+}
+
+// How many subobjects of each class a complete c has. A virtual base is one
+// subobject however many paths reach it.
+auto subobjects(int c) -> std::map<int, int> {
+  std::map<int, int> count;
+  non_virtual_part(c, count);
+  std::set<int> shared;
+  virtual_bases(c, shared);
+  for (auto v : shared) {
+    non_virtual_part(v, count);
+  }
+  return count;
+}
+
+// Whether b can be added as a direct base of c without also being an
+// indirect one, or making one of c's bases indirect too.
+auto can_add(const class_t &c, int b) -> bool {
+  if (c.closure.count(b)) {
+    return false;
+  }
+  for (auto &existing : c.bases) {
+    if (existing.id == b || classes[b].closure.count(existing.id)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void add_base(class_t &c, int b, bool is_virtual) {
+  c.bases.push_back({b, is_virtual});
+  c.closure.insert(b);
+  c.closure.insert(classes[b].closure.begin(), classes[b].closure.end());
+}
+};
+
+int main(int argc, char **argv) {
+  if (argc < 5) {
+    std::fprintf(stderr,
+                 "usage: %s depth fanout secondary virtual-ratio [seed]\n",
+                 argv[0]);
+    return 2;
+  }
+  auto depth = std::atoi(argv[1]);
+  auto fanout = static_cast<size_t>(std::atoi(argv[2]));
+  auto secondary = std::atoi(argv[3]);
+  auto ratio = std::atof(argv[4]);
+  auto seed = argc > 5 ? std::atoi(argv[5]) : 1;
+
+  std::mt19937 rng(seed);
+  std::bernoulli_distribution is_virtual(ratio);
+
+  std::vector<int> level;
+  for (size_t i = 0; i < fanout && i < max_per_level; ++i) {
+    level.push_back(static_cast<int>(classes.size()));
+    classes.push_back(class_t());
+  }
+  for (int d = 1; d < depth; ++d) {
+    auto earlier = static_cast<int>(classes.size());
+    std::vector<int> next;
+    for (auto parent : level) {
+      for (size_t i = 0; i < fanout && next.size() < max_per_level; ++i) {
+        class_t c;
+        add_base(c, parent, is_virtual(rng));
+        for (int s = 0; s < secondary; ++s) {
+          // a few tries at an earlier class that fits
+          for (int attempt = 0; attempt < 8; ++attempt) {
+            auto b = std::uniform_int_distribution<int>(0, earlier - 1)(rng);
+            if (can_add(c, b)) {
+              add_base(c, b, is_virtual(rng));
+              break;
+            }
+          }
+        }
+        next.push_back(static_cast<int>(classes.size()));
+        classes.push_back(c);
+      }
+    }
+    level = next;
+  }
+
+  std::printf("// generated by: hiergen %d %zu %d %g %d\n", depth, fanout,
+              secondary, ratio, seed);
+  std::printf("#include \"dispatch.hpp\"\n\n");
+  for (size_t i = 0; i < classes.size(); ++i) {
+    auto &c = classes[i];
+    std::printf("struct C%zu", i);
+    for (size_t b = 0; b < c.bases.size(); ++b) {
+      std::printf("%s%sC%d", b ? ", " : " : ",
+                  c.bases[b].is_virtual ? "virtual " : "", c.bases[b].id);
+    }
+    std::printf(" {\n");
+    std::printf("  static const int id = %zu;\n", i);
+    std::printf("  virtual int own%zu() { return id; }\n", i);
+    if (c.bases.empty()) {
+      std::printf("  NOINLINE virtual int f() { return m%zu - %zu + id; }\n", i,
+                  i);
+    } else {
+      std::printf("  NOINLINE int f() override { return m%zu - %zu + id; }\n",
+                  i, i);
+    }
+    std::printf("  int m%zu = %zu;\n", i, i);
+    std::printf("};\n");
+  }
+
+  std::printf("\n// any argument prints the column headings first\n");
+  std::printf("int main(int argc, char **) {\n");
+  std::printf("  if (argc > 1) {\n    dispatch::header();\n  }\n");
+  std::printf("  dispatch::report r = {\"depth %d fanout %zu secondary %d "
+              "virtual %.2f\", %zu};\n",
+              depth, fanout, secondary, ratio, classes.size());
+  for (size_t i = 0; i < classes.size(); ++i) {
+    for (auto &count : subobjects(static_cast<int>(i))) {
+      if (count.second == 1) {
+        std::printf("  dispatch::check<C%zu, C%d>(r);\n", i, count.first);
+      }
+    }
+  }
+  std::printf("  return r.finish();\n}\n");
+  return 0;
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+// Identical code folding (gold/lld --icf, MSVC /OPT:ICF) and comdat merging
+// can give two distinct functions one address. A fast path keyed on a
+// function address would then route objects that override the function into
+// the kernel for the function it was folded with. This checks keys against
+// the symbol table before they are trusted.
+
+#include "elf.hpp"
+
+#include <cxxabi.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace stop {
+namespace icf {
+
+inline auto demangle(const std::string &mangled) -> std::string {
+  int status = 0;
+  char *name = abi::__cxa_demangle(mangled.c_str(), nullptr, nullptr, &status);
+  if (status != 0 || !name) {
+    return mangled;
+  }
+  std::string result(name);
+  std::free(name);
+  return result;
+}
+
+// Symbols that are one function under several names rather than folded
+// functions normalise the same: local aliases and clones (".localalias",
+// ".constprop.0"), and the complete and base object variants of
+// constructors and destructors, which demangle identically.
+inline auto normalise(const std::string &mangled) -> std::string {
+  return demangle(mangled.substr(0, mangled.find('.')));
+}
+
+// The distinct functions whose code starts at address in symbols (sorted by
+// address, as elf::ReadSymbols returns them).
+inline auto FunctionsAt(const std::vector<elf::symbol> &symbols,
+                        uintptr_t address) -> std::vector<std::string> {
+  std::set<std::string> seen;
+  std::vector<std::string> names;
+  auto first = std::lower_bound(
+      symbols.begin(), symbols.end(), address,
+      [](const elf::symbol &s, uintptr_t a) { return s.address < a; });
+  for (auto it = first; it != symbols.end() && it->address == address; ++it) {
+    if (it->function && seen.insert(normalise(it->name)).second) {
+      names.push_back(it->name);
+    }
+  }
+  return names;
+}
+
+inline auto FunctionsAt(uintptr_t address) -> std::vector<std::string> {
+  return FunctionsAt(elf::ExecutableSymbols(), address);
+}
+
+// Every address in symbols that more than one distinct function starts at.
+inline auto FoldedFunctions(const std::vector<elf::symbol> &symbols)
+    -> std::vector<std::vector<std::string>> {
+  std::vector<std::vector<std::string>> folded;
+  for (auto it = symbols.begin(); it != symbols.end();) {
+    auto names = FunctionsAt(symbols, it->address);
+    if (names.size() > 1) {
+      folded.push_back(names);
+    }
+    auto address = it->address;
+    while (it != symbols.end() && it->address == address) {
+      ++it;
+    }
+  }
+  return folded;
+}
+
+enum class policy {
+  warn,  // report the collision, but register the key
+  refuse // report it and do not register the key
+};
+
+// The function addresses fast paths compare against. A key is checked when
+// it is added: it must not be the address of more than one function in the
+// executable's symbol table, nor the address of another key. Collisions are
+// reported to report, or nowhere if it is null.
+class fast_path_keys {
+public:
+  explicit fast_path_keys(policy p = policy::refuse,
+                          std::FILE *report = stderr)
+      : policy_(p), report_(report) {}
+
+  // Returns whether the key was registered.
+  auto add(const void *key, const char *what) -> bool {
+    auto address = reinterpret_cast<uintptr_t>(key);
+    std::vector<std::string> others;
+    for (auto &name : FunctionsAt(address)) {
+      others.push_back(demangle(name));
+    }
+    if (others.size() < 2) {
+      others.clear();
+    }
+    for (auto &k : keys_) {
+      if (k.address == address) {
+        others.push_back(std::string("fast-path key ") + k.what);
+      }
+    }
+    if (!others.empty()) {
+      if (report_) {
+        std::fprintf(report_, "%s: fast-path key %s at %p is shared with:\n",
+                     policy_ == policy::refuse ? "error" : "warning", what,
+                     key);
+        for (auto &other : others) {
+          std::fprintf(report_, "    %s\n", other.c_str());
+        }
+      }
+      if (policy_ == policy::refuse) {
+        return false;
+      }
+    }
+    keys_.push_back({address, what});
+    return true;
+  }
+
+  template <typename R, typename... Args>
+  auto add(R (*key)(Args...), const char *what) -> bool {
+    return add(reinterpret_cast<const void *>(key), what);
+  }
+
+  auto contains(const void *key) const -> bool {
+    for (auto &k : keys_) {
+      if (k.address == reinterpret_cast<uintptr_t>(key)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  auto size() const -> size_t { return keys_.size(); }
+
+private:
+  struct key_t {
+    uintptr_t address;
+    std::string what;
+  };
+
+  policy policy_;
+  std::FILE *report_;
+  std::vector<key_t> keys_;
+};
+};
+};
@@ -0,0 +1,44 @@
+// g++ icf_scan.cpp -std=c++11 -Wall -o icf-scan -ldl
+// ./icf-scan <elf file> [name...]
+//
+// Lists the addresses where identical code folding left more than one
+// distinct function. With names, only groups whose demangled names contain
+// one of them are listed, e.g. the fast-path keys of a build:
+//   ./icf-scan Main entity_lerp_fast_impl::Update
+// Exits 1 if anything is listed, so a build can refuse to ship.
+#include "icf.hpp"
+
+#include <cstdio>
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::fprintf(stderr, "usage: %s <elf file> [name...]\n", argv[0]);
+    return 2;
+  }
+  // static addresses are all that matter for finding aliases
+  auto symbols = stop::elf::ReadSymbols(argv[1], 0);
+  if (symbols.empty()) {
+    std::fprintf(stderr, "%s: no symbols in %s\n", argv[0], argv[1]);
+    return 2;
+  }
+  auto collisions = 0;
+  for (auto &group : stop::icf::FoldedFunctions(symbols)) {
+    std::vector<std::string> names;
+    auto wanted = argc == 2;
+    for (auto &name : group) {
+      names.push_back(stop::icf::demangle(name));
+      for (int i = 2; i < argc; ++i) {
+        wanted = wanted || names.back().find(argv[i]) != std::string::npos;
+      }
+    }
+    if (!wanted) {
+      continue;
+    }
+    ++collisions;
+    std::printf("folded:\n");
+    for (auto &name : names) {
+      std::printf("    %s\n", name.c_str());
+    }
+  }
+  return collisions ? 1 : 0;
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include "gfp.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+namespace stop {
+
+inline auto get_vptr(const void *object) -> const void * {
+  return *reinterpret_cast<const void *const *>(object);
+}
+
+// A small direct-mapped cache of one Value per vptr. Anything that depends
+// only on an object's dynamic type can be worked out once per type and then
+// found again with a vptr load and a key compare. A collision just evicts the
+// entry, so the next lookup resolves again.
+//
+// Not thread-safe: use one cache per updating thread.
+template <class Value, size_t Size = 64> class vptr_cache {
+  static_assert((Size & (Size - 1)) == 0, "Size must be a power of two");
+
+public:
+  vptr_cache() : entries_() {}
+
+  template <class Resolve>
+  auto get(const void *vptr, Resolve resolve) -> Value {
+    auto &entry = entries_[slot(vptr)];
+    if (entry.vptr != vptr) {
+      entry.value = resolve();
+      entry.vptr = vptr;
+    }
+    return entry.value;
+  }
+
+private:
+  struct entry_t {
+    const void *vptr;
+    Value value;
+  };
+
+  static auto slot(const void *vptr) -> size_t {
+    // vtables are pointer aligned; mix in higher bits so neighbours spread
+    auto bits = reinterpret_cast<uintptr_t>(vptr);
+    return ((bits >> 3) ^ (bits >> 9)) & (Size - 1);
+  }
+
+  entry_t entries_[Size];
+};
+
+// Answers "does this object's dynamic type override C's member function, or
+// does it still use the reference version?" for one member function pointer
+// of any qualification. The answer is cached per vptr.
+template <typename> class override_query;
+
+template <class C, class F> class override_query<F C::*> {
+public:
+  using pmf_t = F C::*;
+  using this_t = typename pmf<pmf_t>::this_t;
+  using funcptr_t = typename pmf<pmf_t>::funcptr_t;
+
+  // reference is the implementation that counts as "not overridden",
+  // normally C's own.
+  override_query(pmf_t fp, funcptr_t reference)
+      : fp_(fp), reference_(reference) {}
+
+  // Take the reference from an object whose dynamic type provides it.
+  template <class D>
+  override_query(pmf_t fp, D *prototype)
+      : override_query(fp, GetFunctionPointer(prototype, fp)) {}
+
+  auto overrides(this_t obj) -> bool {
+    return cache_.get(get_vptr(inthenameoflove::object_address(obj)),
+                      [this, obj]() {
+                        return GetFunctionPointer(obj, fp_) != reference_;
+                      });
+  }
+
+  auto reference() const -> funcptr_t { return reference_; }
+
+private:
+  pmf_t fp_;
+  funcptr_t reference_;
+  vptr_cache<bool> cache_;
+};
+
+template <class C, class D, class F>
+auto MakeOverrideQuery(F C::*fp, D *prototype) -> override_query<F C::*> {
+  return override_query<F C::*>(fp, prototype);
+}
+
+// The multi-method version: for up to 64 member functions of C (or of its
+// bases), a bitmask per dynamic type of which ones it overrides relative to a
+// reference type. Bit i is set when the i-th function is overridden, so 0
+// means "vanilla" for every method an engine fast path depends on, and the
+// mask works as a sort key for grouping objects by behaviour.
+template <class C> class override_signature {
+public:
+  template <class D, class... Fps>
+  explicit override_signature(D *prototype, Fps... fps) {
+    static_assert(sizeof...(Fps) <= 64, "at most 64 methods per signature");
+    add(static_cast<C *>(prototype), fps...);
+  }
+
+  auto mask(C *obj) -> uint64_t {
+    return cache_.get(get_vptr(obj), [this, obj]() {
+      uint64_t mask = 0;
+      for (size_t i = 0; i < methods_.size(); ++i) {
+        if (resolve(obj, methods_[i]) != methods_[i].reference) {
+          mask |= uint64_t(1) << i;
+        }
+      }
+      return mask;
+    });
+  }
+
+  auto vanilla(C *obj) -> bool { return mask(obj) == 0; }
+  auto size() const -> size_t { return methods_.size(); }
+
+private:
+  // The Itanium member function pointer, with the signature erased
+  struct method_t {
+    uintptr_t ptr; // function address, or 1 + vtable byte offset if virtual
+    ptrdiff_t adj; // to the subobject whose vtable holds the slot
+    uintptr_t reference;
+  };
+
+  static auto resolve(C *obj, const method_t &m) -> uintptr_t {
+    if ((m.ptr & 1) == 0) {
+      return m.ptr;
+    }
+    auto *subobject = reinterpret_cast<char *>(obj) + m.adj;
+    return inthenameoflove::get_vtable_entry(
+        subobject, static_cast<ptrdiff_t>((m.ptr - 1) / sizeof(uintptr_t)));
+  }
+
+  void add(C *) {}
+
+  template <class B, class F, class... Fps>
+  void add(C *prototype, F B::*fp, Fps... fps) {
+    static_assert(std::is_function<F>::value,
+                  "override_signature needs pointers to member functions");
+    // as a pointer to a member of C, a base's function carries the
+    // adjustment to that base. The layout is the same for every
+    // qualification, see pmf_layout.
+    F C::*cfp = fp;
+    static_assert(sizeof(cfp) == sizeof(uintptr_t) + sizeof(ptrdiff_t),
+                  "expected an Itanium member function pointer");
+    method_t m;
+    std::memcpy(&m.ptr, &cfp, sizeof(uintptr_t));
+    std::memcpy(&m.adj, reinterpret_cast<char *>(&cfp) + sizeof(uintptr_t),
+                sizeof(ptrdiff_t));
+    m.reference = resolve(prototype, m);
+    methods_.push_back(m);
+    add(prototype, fps...);
+  }
+
+  std::vector<method_t> methods_;
+  vptr_cache<uint64_t> cache_;
+};
+
+// Move the objects that override none of signature's methods to the front of
+// [first, last) and return the end of that group. Works on ranges of raw or
+// smart pointers to C.
+template <class It, class C>
+auto PartitionVanilla(It first, It last, override_signature<C> &signature)
+    -> It {
+  using value_t = typename std::iterator_traits<It>::value_type;
+  return std::stable_partition(first, last, [&signature](const value_t &p) {
+    return signature.vanilla(&*p);
+  });
+}
+
+// Order [first, last) by override mask, so objects that behave the same for
+// every method in the signature are contiguous.
+template <class It, class C>
+void GroupBySignature(It first, It last, override_signature<C> &signature) {
+  using value_t = typename std::iterator_traits<It>::value_type;
+  std::stable_sort(first, last,
+                   [&signature](const value_t &a, const value_t &b) {
+                     return signature.mask(&*a) < signature.mask(&*b);
+                   });
+}
+};
@@ -3,6 +3,8 @@
 // https://raw.githubusercontent.com/philsquared/Catch/master/single_include/catch.hpp
 #include "catch.hpp"
 
+#include <functional>
+
 enum class result_t {
   single,
   base,
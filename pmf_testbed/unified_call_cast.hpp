@@ -0,0 +1,60 @@
+#pragma once
+
+#include "gfp.hpp"
+
+#include <type_traits>
+
+namespace stop {
+
+namespace inthenameoflove {
+
+// Splits the target function pointer type R (*)(P, Args...) of a call cast.
+// The member pointer is read through the stop::pmf of R (C::*)(Args...): the
+// Itanium layout is the same whatever cv or ref qualifiers the member
+// function has, so they need no decomposing here.
+template <typename> struct call_cast_traits;
+
+template <class R, class P, typename... Args>
+struct call_cast_traits<R (*)(P, Args...)> {
+  static_assert(std::is_pointer<P>::value,
+                "the first parameter of a call cast target receives this");
+  template <class C> using pmf_t = pmf<R (C::*)(Args...)>;
+};
+
+template <class To, class C, class FP>
+auto call_cast_pmf(const FP *fp) -> const
+    typename call_cast_traits<To>::template pmf_t<C> * {
+  static_assert(std::is_member_function_pointer<FP>::value,
+                "unified_call_cast needs a pointer to member function");
+  using pmf_t = typename call_cast_traits<To>::template pmf_t<C>;
+  static_assert(sizeof(FP) == sizeof(pmf_t),
+                "not an Itanium member function pointer");
+  return reinterpret_cast<const pmf_t *>(fp);
+}
+};
+
+// The portable form of GCC's bound member function extension,
+// (To)(obj.*fp), as sketched in P0130: the function obj.*fp calls, as a
+// non-member function To taking the object first. Works on any Itanium ABI
+// compiler. For a virtual function this is the vptr load and slot load the
+// extension emits; call the result with GetAdjustedThisPointer(&obj, fp).
+template <class To, class C, class D, class M>
+auto unified_call_cast(const D &obj, M C::*fp) -> To {
+  auto *pPMF = inthenameoflove::call_cast_pmf<To, C>(&fp);
+  return reinterpret_cast<To>(
+      pPMF->getptr(static_cast<C *>(const_cast<D *>(&obj))));
+}
+
+template <class To, class C, class D, class M>
+auto unified_call_cast(D *obj, M C::*fp) -> To {
+  return unified_call_cast<To>(*obj, fp);
+}
+
+// Without an object: only a non-virtual function can be named, so a virtual
+// one gives nullptr. See GetFunctionPointer<D> to resolve those by type.
+template <class To, class C, class M>
+auto unified_call_cast(M C::*fp) -> To {
+  auto *pPMF = inthenameoflove::call_cast_pmf<To, C>(&fp);
+  return reinterpret_cast<To>(pPMF->getptr());
+}
+};
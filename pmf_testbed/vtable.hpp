@@ -0,0 +1,148 @@
+#pragma once
+
+#include "elf.hpp"
+#include "overrides.hpp"
+
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+namespace stop {
+
+// The virtual function slots an object's vptr points at, and the vtable
+// group they are part of.
+//
+// The group is the _ZTV symbol that contains the vptr: the primary vtable and
+// then one secondary vtable per base that needs its own. Each table is a
+// prefix of vcall and vbase offsets, offset-to-top and the RTTI pointer,
+// followed by the slots. Offsets are small integers and the RTTI pointer is
+// data, so a table's slots run from its address point up to the first word
+// that is not the address of code in some loaded module.
+struct vtable_view {
+  struct table_t {
+    const uintptr_t *table; // address point
+    size_t size;            // slots
+  };
+
+  const uintptr_t *table; // the address point, i.e. the vptr
+  size_t size;            // slots; 0 when none, or the symbol was not found
+  std::string symbol;     // mangled _ZTV name, when found
+  // every table of the group that has slots, in layout order
+  std::vector<table_t> group;
+
+  auto operator[](size_t i) const -> uintptr_t { return table[i]; }
+  auto begin() const -> const uintptr_t * { return table; }
+  auto end() const -> const uintptr_t * { return table + size; }
+  auto rtti() const -> uintptr_t { return table[-1]; }
+
+  // FNV-1a over every slot target of every table in the group, each taken
+  // relative to the module that holds it so the value does not change with
+  // the load address. Objects whose dynamic types behave the same for every
+  // virtual function, through whichever base, hash the same, even though
+  // their vtables are distinct.
+  auto hash() const -> uint64_t {
+    uint64_t h = 14695981039346656037ull;
+    for (auto &t : group) {
+      for (size_t i = 0; i < t.size; ++i) {
+        auto target = t.table[i];
+        auto relative =
+            target - elf::ModuleBase(reinterpret_cast<void *>(target));
+        for (size_t byte = 0; byte < sizeof(relative); ++byte) {
+          h ^= (relative >> (byte * 8)) & 0xff;
+          h *= 1099511628211ull;
+        }
+      }
+    }
+    return h;
+  }
+};
+
+inline auto GetVtable(const void *object) -> vtable_view {
+  auto *table = static_cast<const uintptr_t *>(get_vptr(object));
+  vtable_view view = {table, 0, std::string(), {}};
+  elf::symbol symbol;
+  if (!elf::FindSymbol(table, symbol)) {
+    return view;
+  }
+  auto rtti = table[-1];
+  auto is_slot = [rtti](uintptr_t word) {
+    return word != rtti && elf::ModuleBase(reinterpret_cast<void *>(word));
+  };
+  auto *first = reinterpret_cast<const uintptr_t *>(symbol.address);
+  auto words = symbol.size / sizeof(uintptr_t);
+  for (size_t i = 0; i < words;) {
+    while (i < words && !is_slot(first[i])) {
+      ++i;
+    }
+    auto point = i;
+    while (i < words && is_slot(first[i])) {
+      ++i;
+    }
+    if (i > point) {
+      view.group.push_back({first + point, i - point});
+      if (first + point == table) {
+        view.size = i - point;
+      }
+    }
+  }
+  view.symbol = symbol.name;
+  return view;
+}
+
+// A sort key for grouping objects whose dynamic types behave the same for
+// every virtual function: the vtable hash, cached per vptr.
+class vtable_identity {
+public:
+  auto key(const void *object) -> uint64_t {
+    return cache_.get(get_vptr(object),
+                      [object]() { return GetVtable(object).hash(); });
+  }
+
+private:
+  vptr_cache<uint64_t> cache_;
+};
+
+// typeid(*object) for a polymorphic object, read from the RTTI slot before
+// the address point. Every vtable in a group, primary or secondary, points
+// at the complete object's type_info, so any base subobject will do.
+inline auto GetTypeInfo(const void *object) -> const std::type_info & {
+  auto *table = static_cast<const std::type_info *const *>(get_vptr(object));
+  return *table[-1];
+}
+
+// A map key for a dynamic type whose hash was worked out once per type. The
+// hash is type_info::hash_code(), so it agrees with std::type_index, but
+// looking it up costs a vptr load and a cache probe rather than hashing the
+// mangled name for every object.
+struct type_key {
+  const std::type_info *type;
+  size_t hash;
+
+  // type_info equality, which copes with one type having several type_info
+  // objects across shared libraries
+  auto operator==(const type_key &other) const -> bool {
+    return hash == other.hash && *type == *other.type;
+  }
+  auto operator!=(const type_key &other) const -> bool {
+    return !(*this == other);
+  }
+
+  struct hasher {
+    auto operator()(const type_key &key) const -> size_t { return key.hash; }
+  };
+};
+
+// The type_key of an object's dynamic type, cached per vptr.
+class type_identity {
+public:
+  auto key(const void *object) -> type_key {
+    return cache_.get(get_vptr(object), [object]() {
+      auto &type = GetTypeInfo(object);
+      return type_key{&type, type.hash_code()};
+    });
+  }
+
+private:
+  vptr_cache<type_key> cache_;
+};
+};